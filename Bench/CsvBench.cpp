@@ -0,0 +1,64 @@
+// CSV parse benchmark, kept out of the application: sql-gui.vcxproj doesn't compile this file.
+// Build it on its own with the parser's sources, e.g.
+//   cl /O2 /std:c++17 /EHsc Bench\CsvBench.cpp Serialisation\*.cpp
+//   g++ -O2 -std=c++17 Bench/CsvBench.cpp Serialisation/*.cpp -lpthread
+// csv-bench <file>: parses the file with 1, 2, 4... threads up to the core count and prints the
+// best of three runs for each, so the speedup of the chunked parser can be measured.
+
+#include "../Serialisation/BinaryReader.h"
+#include "../Serialisation/CSVScanner.h"
+#include "../Serialisation/DataTable.h"
+#include "../Serialisation/MappedFile.h"
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <thread>
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		printf("usage: csv-bench <file>\n");
+		return 1;
+	}
+
+	const char* Path = argv[1];
+	MappedFilePtr File = MappedFile::Open(Path);
+	if (!File)
+	{
+		printf("could not open %s\n", Path);
+		return 1;
+	}
+
+	const size_t Cores = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+	printf("%s: %.1f MB, %zu cores, %s scanner\n", Path, File->GetSize() / (1024.0 * 1024.0), Cores,
+		CSVScanner::GetInstructionSetName(CSVScanner::GetInstructionSet()));
+
+	double SingleThreadSeconds = 0.0;
+	for (size_t Threads = 1; ; Threads = std::min(Threads * 2, Cores))
+	{
+		double BestSeconds = 0.0;
+		size_t Rows = 0;
+		for (int Run = 0; Run < 3; ++Run)
+		{
+			BinaryReader Reader(*File);
+			const auto Start = std::chrono::steady_clock::now();
+			TypedDataTablePtr Table = TypedDataTable::CreateFromCSV(Reader, 1, 0, nullptr, Threads);
+			const double Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+			BestSeconds = Run == 0 ? Seconds : std::min(BestSeconds, Seconds);
+			Rows = Table->GetNumRows();
+		}
+		if (Threads == 1)
+		{
+			SingleThreadSeconds = BestSeconds;
+		}
+
+		printf("%3zu threads: %8.3f s  %8.1f MB/s  %6.2fx  (%zu rows)\n", Threads, BestSeconds,
+			File->GetSize() / (1024.0 * 1024.0) / BestSeconds, SingleThreadSeconds / BestSeconds, Rows);
+		if (Threads == Cores)
+		{
+			break;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,652 @@
+#include "CsvImporter.h"
+#include "QueryExecutor.h"
+#include "StatementCache.h"
+#include "../Serialisation/BinaryReader.h"
+#include "../Serialisation/CSVScanner.h"
+#include "../Serialisation/CSVSniffer.h"
+#include "../sqlite/sqlite3.h"
+#include <algorithm>
+#include <string.h>
+
+namespace
+{
+	std::string QuoteIdentifier(const std::string& Name)
+	{
+		std::string Quoted = "\"";
+		for (const char Character : Name)
+		{
+			Quoted += Character;
+			if (Character == '"')
+			{
+				Quoted += '"';
+			}
+		}
+		Quoted += '"';
+		return Quoted;
+	}
+
+	// "(name TYPE, ...)" for a CREATE TABLE
+	std::string GetColumnDefinitions(const std::vector<std::string>& Names, const std::vector<ColumnDataType>& Types)
+	{
+		std::string Definitions = "(";
+		for (size_t Column = 0; Column < Names.size(); ++Column)
+		{
+			Definitions += (Column > 0 ? ", " : "") + QuoteIdentifier(Names[Column]) + " " + TypedDataTable::GetColumnDataTypeName(Types[Column]);
+		}
+		return Definitions + ")";
+	}
+
+	bool TableExists(sqlite3& Connection, const std::string& TableName)
+	{
+		sqlite3_stmt* Statement = nullptr;
+		if (sqlite3_prepare_v2(&Connection, "SELECT 1 FROM sqlite_master WHERE type='table' AND name=?1 COLLATE NOCASE", -1, &Statement, nullptr) != SQLITE_OK)
+		{
+			sqlite3_finalize(Statement);
+			return false;
+		}
+		sqlite3_bind_text(Statement, 1, TableName.c_str(), -1, SQLITE_TRANSIENT);
+		const bool Exists = sqlite3_step(Statement) == SQLITE_ROW;
+		sqlite3_finalize(Statement);
+		return Exists;
+	}
+
+	// tables, indexes, views and triggers share one namespace
+	bool NameInUse(sqlite3& Connection, const std::string& Name)
+	{
+		sqlite3_stmt* Statement = nullptr;
+		if (sqlite3_prepare_v2(&Connection, "SELECT 1 FROM sqlite_master WHERE name=?1 COLLATE NOCASE", -1, &Statement, nullptr) != SQLITE_OK)
+		{
+			sqlite3_finalize(Statement);
+			return false;
+		}
+		sqlite3_bind_text(Statement, 1, Name.c_str(), -1, SQLITE_TRANSIENT);
+		const bool InUse = sqlite3_step(Statement) == SQLITE_ROW;
+		sqlite3_finalize(Statement);
+		return InUse;
+	}
+}
+
+std::shared_ptr<CsvImporter> CsvImporter::Start(QueryExecutor& Executor, const std::string& FilePath, const std::string& TableName, bool BulkLoad)
+{
+	MappedFilePtr File = MappedFile::Open(FilePath);
+	if (!File)
+	{
+		return nullptr;
+	}
+
+	auto Importer = std::make_shared<CsvImporter>(Executor, std::move(File), TableName, BulkLoad);
+	std::weak_ptr<CsvImporter> Weak = Importer;
+
+	if (BulkLoad)
+	{
+		// the relaxed settings belong to the worker connection, so the load keeps the worker until
+		// it is done; queries from the SQL tab wait rather than run without durability in between
+		Executor.PostExclusive([Weak](StatementCache& Statements)
+		{
+			if (auto Live = Weak.lock())
+			{
+				// the settings and the dropped indexes would land in a transaction the SQL tab left
+				// open, and its COMMIT or ROLLBACK would then decide what happens to them
+				if (!sqlite3_get_autocommit(&Statements.GetConnection()))
+				{
+					Live->Finish(Statements.GetConnection(), "Bulk load needs the open transaction to be committed or rolled back first");
+					return;
+				}
+				if (!Live->PrepareTable(Statements))
+				{
+					return;
+				}
+				Live->BeginBulkLoad(Statements.GetConnection());
+			}
+
+			// locked per batch, so dropping the importer still stops it after the batch in progress
+			for (;;)
+			{
+				auto Live = Weak.lock();
+				if (!Live || Live->IsFinished() || !Live->ImportBatch(Statements))
+				{
+					break;
+				}
+			}
+		});
+		return Importer;
+	}
+
+	Executor.PostExclusive([Weak](StatementCache& Statements)
+	{
+		if (auto Live = Weak.lock())
+		{
+			Live->PrepareTable(Statements);
+		}
+	});
+
+	Executor.PostBackground([Weak](StatementCache& Statements)
+	{
+		auto Live = Weak.lock();
+		return Live && !Live->IsFinished() && Live->ImportBatch(Statements);
+	});
+	return Importer;
+}
+
+CsvImporter::CsvImporter(QueryExecutor& Executor, MappedFilePtr File, const std::string& TableName, bool BulkLoad)
+	: mExecutor(Executor)
+	, mFile(std::move(File))
+	, mTableName(TableName)
+	, mBulkLoad(BulkLoad)
+	, mFinished(false)
+	, mCancelRequested(false)
+	, mRowsImported(0)
+	, mBytesImported(0)
+	, mStartTime(Clock::now())
+	, mParsersRunning(0)
+	, mStopping(false)
+{
+	// the writer is the executor's worker, so one core is left for it
+	const size_t NumParsers = std::max<size_t>(std::thread::hardware_concurrency(), 2) - 1;
+	for (size_t Ring = 0; Ring < NumParsers; ++Ring)
+	{
+		mRings.push_back(std::make_unique<SPSCRing<ParsedBatch>>(RingBatches));
+	}
+}
+
+CsvImporter::~CsvImporter()
+{
+	StopParsers();
+
+	// dropped mid-import: the indexes and settings still have to come back, on the worker
+	if (mBulkLoadState.Active)
+	{
+		mExecutor.PostExclusive([TableName = mTableName, State = std::move(mBulkLoadState)](StatementCache& Statements)
+		{
+			EndBulkLoad(Statements.GetConnection(), TableName, State, false);
+		});
+	}
+}
+
+float CsvImporter::GetProgress() const
+{
+	const size_t Size = mFile->GetSize();
+	return Size > 0 ? static_cast<float>(static_cast<double>(mBytesImported.load()) / static_cast<double>(Size)) : 1.0f;
+}
+
+std::string CsvImporter::GetErrorMessage() const
+{
+	std::lock_guard<std::mutex> Lock(mMutex);
+	return mErrorMessage;
+}
+
+double CsvImporter::GetRowsPerSecond() const
+{
+	const double Seconds = std::chrono::duration<double>(Clock::now() - mStartTime).count();
+	return Seconds > 0.0 ? static_cast<double>(mRowsImported.load()) / Seconds : 0.0;
+}
+
+double CsvImporter::GetMegabytesPerSecond() const
+{
+	const double Seconds = std::chrono::duration<double>(Clock::now() - mStartTime).count();
+	return Seconds > 0.0 ? static_cast<double>(mBytesImported.load()) / (1024.0 * 1024.0) / Seconds : 0.0;
+}
+
+size_t CsvImporter::GetQueuedBatches() const
+{
+	size_t Queued = 0;
+	for (const auto& Ring : mRings)
+	{
+		Queued += Ring->GetSize();
+	}
+	return Queued;
+}
+
+bool CsvImporter::PrepareTable(StatementCache& Statements)
+{
+	sqlite3& Connection = Statements.GetConnection();
+	const uint8_t* Data = mFile->GetData();
+	const size_t Length = mFile->GetSize();
+
+	const CSVSniffer::Result Sniffed = CSVSniffer::Sniff(Data, Length);
+	mDelimiter = Sniffed.Delimiter;
+	mNumColumns = Sniffed.Columns.size();
+	mSplitOffset = Sniffed.DataStart;
+	// nullability isn't declared: a NOT NULL the sample got wrong would fail the import part way
+	for (const CSVSniffer::Column& Column : Sniffed.Columns)
+	{
+		std::string Name = Column.Name;
+		std::replace(Name.begin(), Name.end(), ' ', '_');
+		mColumnNames.push_back(std::move(Name));
+		mColumnTypes.push_back(Column.Type);
+	}
+
+	mCreatedTable = !TableExists(Connection, mTableName);
+	const std::string CreateQuery = "CREATE TABLE IF NOT EXISTS " + QuoteIdentifier(mTableName) + " " + GetColumnDefinitions(mColumnNames, mColumnTypes);
+	mInsertQuery = "INSERT INTO " + QuoteIdentifier(mTableName) + " VALUES (";
+	for (size_t Column = 0; Column < mNumColumns; ++Column)
+	{
+		mInsertQuery += (Column > 0 ? ", ?" : "?") + std::to_string(Column + 1);
+	}
+	mInsertQuery += ")";
+
+	char* ErrorMessage = nullptr;
+	if (sqlite3_exec(&Connection, CreateQuery.c_str(), nullptr, nullptr, &ErrorMessage) != SQLITE_OK)
+	{
+		Finish(Connection, ErrorMessage);
+		sqlite3_free(ErrorMessage);
+		return false;
+	}
+
+	mParsersRunning = mRings.size();
+	for (size_t Ring = 0; Ring < mRings.size(); ++Ring)
+	{
+		mParsers.emplace_back(&CsvImporter::ParserMain, this, Ring);
+	}
+	return true;
+}
+
+bool CsvImporter::ImportBatch(StatementCache& Statements)
+{
+	// how long the writer waits for a parser before handing the worker back to other work
+	constexpr auto MaxWait = std::chrono::milliseconds(20);
+
+	sqlite3& Connection = Statements.GetConnection();
+	if (mCancelRequested)
+	{
+		Finish(Connection, "Import cancelled");
+		return false;
+	}
+
+	ParsedBatch* Batch = nullptr;
+	size_t Ring = 0;
+	const Clock::time_point Deadline = Clock::now() + MaxWait;
+	while (!Batch)
+	{
+		// read before looking at the rings: a parser pushes its last batch before it stops
+		const bool ParsersDone = mParsersRunning.load() == 0;
+		Batch = FindNextBatch(Ring);
+		if (Batch)
+		{
+			break;
+		}
+		if (ParsersDone)
+		{
+			Finish(Connection, nullptr);
+			return false;
+		}
+		if (Clock::now() >= Deadline)
+		{
+			return true;
+		}
+		std::this_thread::yield();
+	}
+
+	if (Batch->Table)
+	{
+		WidenTypes(*Batch->Table);
+	}
+	if (mTypesWidened)
+	{
+		if (!mBulkLoad)
+		{
+			// The rebuild drops a table, which fails while a cursor is part way through its rows, so
+			// it runs as an exclusive task; tasks go ahead of background work, so this batch waits
+			// in its ring until the table has its new types.
+			mExecutor.PostExclusive([Weak = weak_from_this()](StatementCache& Statements)
+			{
+				auto Live = Weak.lock();
+				if (!Live || Live->IsFinished())
+				{
+					return;
+				}
+				const std::string ErrorMessage = Live->ApplyWidenedTypes(Statements.GetConnection());
+				if (!ErrorMessage.empty())
+				{
+					Live->Finish(Statements.GetConnection(), ErrorMessage.c_str());
+				}
+			});
+			return true;
+		}
+
+		// a bulk load already holds the worker with the cursors parked
+		const std::string ErrorMessage = ApplyWidenedTypes(Connection);
+		if (!ErrorMessage.empty())
+		{
+			Finish(Connection, ErrorMessage.c_str());
+			return false;
+		}
+	}
+
+	if (Batch->Table && !InsertRows(Statements, *Batch->Table, Batch->Rows))
+	{
+		return false;
+	}
+	mRowsImported += static_cast<int64_t>(Batch->Rows);
+	mBytesImported = Batch->End;
+	mRings[Ring]->Pop();
+	mNextToWrite++;
+	return true;
+}
+
+CsvImporter::ParsedBatch* CsvImporter::FindNextBatch(size_t& OutRing)
+{
+	for (size_t Ring = 0; Ring < mRings.size(); ++Ring)
+	{
+		ParsedBatch* Front = mRings[Ring]->Front();
+		if (Front && Front->Sequence == mNextToWrite)
+		{
+			OutRing = Ring;
+			return Front;
+		}
+	}
+	return nullptr;
+}
+
+void CsvImporter::ParserMain(size_t Ring)
+{
+	const uint8_t* Data = mFile->GetData();
+	const size_t Length = mFile->GetSize();
+	SPSCRing<ParsedBatch>& Output = *mRings[Ring];
+
+	while (!mStopping)
+	{
+		size_t Sequence = 0;
+		size_t Start = 0;
+		size_t End = 0;
+		{
+			std::lock_guard<std::mutex> Lock(mSplitMutex);
+			if (mSplitOffset >= Length)
+			{
+				break;
+			}
+			Start = mSplitOffset;
+			End = Start + CSVScanner::FindRowsEnd(Data + Start, Length - Start, BatchRows);
+			mSplitOffset = End;
+			Sequence = mNextSequence++;
+		}
+
+		ParsedBatch Batch = ParseBatch(Start, End);
+		Batch.Sequence = Sequence;
+		while (!Output.TryPush(Batch))
+		{
+			if (mStopping)
+			{
+				break;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+	mParsersRunning--;
+}
+
+CsvImporter::ParsedBatch CsvImporter::ParseBatch(size_t Start, size_t End) const
+{
+	ParsedBatch Batch;
+	Batch.End = End;
+	if (End == Start || mNumColumns == 0)
+	{
+		return Batch;
+	}
+
+	const uint8_t* Data = mFile->GetData() + Start;
+	const size_t Length = End - Start;
+	BinaryReader Reader(Data, Length);
+	Batch.Table = TypedDataTable::CreateFromCSV(Reader, 0, 0, nullptr, 1, mNumColumns, mDelimiter);
+
+	// a batch ending on a newline has an empty row after it, which isn't part of the file
+	Batch.Rows = Batch.Table->GetNumRows() - (Data[Length - 1] == '\n' ? 1 : 0);
+	return Batch;
+}
+
+bool CsvImporter::InsertRows(StatementCache& Statements, const TypedDataTable& Batch, size_t Rows)
+{
+	sqlite3& Connection = Statements.GetConnection();
+	sqlite3_stmt* Statement = nullptr;
+	if (!Statements.Acquire(mInsertQuery, Statement) || !Statement)
+	{
+		Finish(Connection, sqlite3_errmsg(&Connection));
+		return false;
+	}
+
+	// Each column is bound from the vector its batch parsed it into; SQLite applies the table's
+	// affinity if the batch typed the column differently from the sample, and the declared type is
+	// widened at the end. The batch outlives the statement's use of its strings, so text is bound
+	// without a copy.
+	std::vector<ColumnDataType> Types(mNumColumns);
+	std::vector<const std::vector<int64_t>*> Integers(mNumColumns);
+	std::vector<const std::vector<double>*> Reals(mNumColumns);
+	std::vector<const TextColumn*> Strings(mNumColumns);
+	for (size_t Column = 0; Column < mNumColumns; ++Column)
+	{
+		Types[Column] = Batch.GetColumnDataType(Column);
+		Integers[Column] = Batch.GetColumnInteger(Column);
+		Reals[Column] = Batch.GetColumnFloat(Column);
+		Strings[Column] = Batch.GetColumnString(Column);
+	}
+
+	// The SQL tab shares the connection; a transaction it left open must not be committed or
+	// rolled back by the import, so the import stops instead of writing into it
+	if (!sqlite3_get_autocommit(&Connection) || sqlite3_exec(&Connection, "BEGIN", nullptr, nullptr, nullptr) != SQLITE_OK)
+	{
+		const std::string ErrorMessage = sqlite3_get_autocommit(&Connection) ? sqlite3_errmsg(&Connection) : "a transaction is already open on the connection";
+		Statements.Release(Statement);
+		Finish(Connection, ErrorMessage.c_str());
+		return false;
+	}
+	for (size_t Row = 0; Row < Rows; ++Row)
+	{
+		for (size_t Column = 0; Column < mNumColumns; ++Column)
+		{
+			const int Parameter = static_cast<int>(Column + 1);
+			if (Batch.IsCellEmpty(Row, Column))
+			{
+				sqlite3_bind_null(Statement, Parameter);
+				continue;
+			}
+			switch (Types[Column])
+			{
+			case ColumnDataType::Integer:
+				sqlite3_bind_int64(Statement, Parameter, (*Integers[Column])[Row]);
+				break;
+			case ColumnDataType::Real:
+				sqlite3_bind_double(Statement, Parameter, (*Reals[Column])[Row]);
+				break;
+			case ColumnDataType::Text:
+			{
+				const std::string_view Cell = Strings[Column]->Get(Row);
+				sqlite3_bind_text(Statement, Parameter, Cell.data(), static_cast<int>(Cell.size()), SQLITE_STATIC);
+				break;
+			}
+			default:
+				sqlite3_bind_null(Statement, Parameter);
+				break;
+			}
+		}
+
+		if (sqlite3_step(Statement) != SQLITE_DONE)
+		{
+			// rolled back before Finish so a bulk load's cleanup runs outside the transaction
+			const std::string ErrorMessage = sqlite3_errmsg(&Connection);
+			Statements.Release(Statement);
+			sqlite3_exec(&Connection, "ROLLBACK", nullptr, nullptr, nullptr);
+			Finish(Connection, ErrorMessage.c_str());
+			return false;
+		}
+		sqlite3_reset(Statement);
+	}
+	// Release clears the bindings, so nothing points into the batch once it is freed
+	Statements.Release(Statement);
+
+	if (sqlite3_exec(&Connection, "COMMIT", nullptr, nullptr, nullptr) != SQLITE_OK)
+	{
+		const std::string ErrorMessage = sqlite3_errmsg(&Connection);
+		sqlite3_exec(&Connection, "ROLLBACK", nullptr, nullptr, nullptr);
+		Finish(Connection, ErrorMessage.c_str());
+		return false;
+	}
+	return true;
+}
+
+void CsvImporter::WidenTypes(const TypedDataTable& Batch)
+{
+	for (size_t Column = 0; Column < mNumColumns; ++Column)
+	{
+		const ColumnDataType Widened = CSVSniffer::WidenType(mColumnTypes[Column], Batch.GetColumnDataType(Column));
+		// a table that was already there keeps the types it was declared with
+		mTypesWidened = mTypesWidened || (mCreatedTable && Widened != mColumnTypes[Column]);
+		mColumnTypes[Column] = Widened;
+	}
+}
+
+std::string CsvImporter::ApplyWidenedTypes(sqlite3& Connection)
+{
+	if (!mTypesWidened)
+	{
+		return std::string();
+	}
+	// the rebuild's own BEGIN would fail, and its ROLLBACK end the user's transaction
+	if (!sqlite3_get_autocommit(&Connection))
+	{
+		return "Couldn't widen the column types: a transaction is already open on the connection";
+	}
+
+	// SQLite can't change a column's declared type in place, so the rows are copied into a table
+	// declared with the wider types which then takes the old one's name. Numbers already stored in
+	// a column that became text read back in their canonical form. The copy's name must not clash
+	// with any table, index or view already there.
+	std::string RebuiltName = mTableName + "_widened";
+	for (int Suffix = 2; NameInUse(Connection, RebuiltName); ++Suffix)
+	{
+		RebuiltName = mTableName + "_widened_" + std::to_string(Suffix);
+	}
+	const std::string Quoted = QuoteIdentifier(mTableName);
+	const std::string Rebuilt = QuoteIdentifier(RebuiltName);
+	const std::string RebuildQuery = "BEGIN;"
+		"CREATE TABLE " + Rebuilt + " " + GetColumnDefinitions(mColumnNames, mColumnTypes) + ";"
+		"INSERT INTO " + Rebuilt + " SELECT * FROM " + Quoted + ";"
+		"DROP TABLE " + Quoted + ";"
+		"ALTER TABLE " + Rebuilt + " RENAME TO " + Quoted + ";"
+		"COMMIT;";
+	char* ErrorMessage = nullptr;
+	if (sqlite3_exec(&Connection, RebuildQuery.c_str(), nullptr, nullptr, &ErrorMessage) != SQLITE_OK)
+	{
+		const std::string Message = std::string("Couldn't widen the column types: ") + (ErrorMessage ? ErrorMessage : "");
+		sqlite3_free(ErrorMessage);
+		// no transaction was open before, so one open now is the rebuild's
+		if (!sqlite3_get_autocommit(&Connection))
+		{
+			sqlite3_exec(&Connection, "ROLLBACK", nullptr, nullptr, nullptr);
+		}
+		return Message;
+	}
+	mTypesWidened = false;
+	return std::string();
+}
+
+void CsvImporter::BeginBulkLoad(sqlite3& Connection)
+{
+	// Bulk-load page cache in KiB, as a negative cache_size takes it
+	constexpr int BulkLoadCacheKiB = 256 * 1024;
+
+	sqlite3_stmt* Statement = nullptr;
+	if (sqlite3_prepare_v2(&Connection, "SELECT (SELECT journal_mode FROM pragma_journal_mode), (SELECT synchronous FROM pragma_synchronous), (SELECT cache_size FROM pragma_cache_size)", -1, &Statement, nullptr) != SQLITE_OK)
+	{
+		sqlite3_finalize(Statement);
+		return;
+	}
+	if (sqlite3_step(Statement) == SQLITE_ROW)
+	{
+		const unsigned char* JournalMode = sqlite3_column_text(Statement, 0);
+		mBulkLoadState.JournalMode = JournalMode ? reinterpret_cast<const char*>(JournalMode) : "delete";
+		mBulkLoadState.Synchronous = sqlite3_column_int(Statement, 1);
+		mBulkLoadState.CacheSize = sqlite3_column_int(Statement, 2);
+	}
+	sqlite3_finalize(Statement);
+
+	// indexes SQLite made for UNIQUE and PRIMARY KEY constraints have no SQL and can't be dropped
+	if (sqlite3_prepare_v2(&Connection, "SELECT name, sql FROM sqlite_master WHERE type = 'index' AND tbl_name = ?1 COLLATE NOCASE AND sql IS NOT NULL", -1, &Statement, nullptr) == SQLITE_OK)
+	{
+		sqlite3_bind_text(Statement, 1, mTableName.c_str(), static_cast<int>(mTableName.size()), SQLITE_STATIC);
+		std::vector<std::string> IndexNames;
+		while (sqlite3_step(Statement) == SQLITE_ROW)
+		{
+			IndexNames.push_back(reinterpret_cast<const char*>(sqlite3_column_text(Statement, 0)));
+			mBulkLoadState.IndexDefinitions.push_back(reinterpret_cast<const char*>(sqlite3_column_text(Statement, 1)));
+		}
+		sqlite3_finalize(Statement);
+
+		for (const std::string& Index : IndexNames)
+		{
+			sqlite3_exec(&Connection, ("DROP INDEX " + QuoteIdentifier(Index)).c_str(), nullptr, nullptr, nullptr);
+		}
+	}
+
+	// a journal in memory can still roll back a failed batch, unlike journal_mode = OFF
+	sqlite3_exec(&Connection, "PRAGMA journal_mode = MEMORY", nullptr, nullptr, nullptr);
+	sqlite3_exec(&Connection, "PRAGMA synchronous = OFF", nullptr, nullptr, nullptr);
+	sqlite3_exec(&Connection, ("PRAGMA cache_size = " + std::to_string(-BulkLoadCacheKiB)).c_str(), nullptr, nullptr, nullptr);
+	mBulkLoadState.Active = true;
+}
+
+std::string CsvImporter::EndBulkLoad(sqlite3& Connection, const std::string& TableName, const BulkLoadState& State, bool Check)
+{
+	std::string ErrorMessage;
+	for (const std::string& Definition : State.IndexDefinitions)
+	{
+		char* IndexError = nullptr;
+		if (sqlite3_exec(&Connection, Definition.c_str(), nullptr, nullptr, &IndexError) != SQLITE_OK)
+		{
+			ErrorMessage += std::string(ErrorMessage.empty() ? "" : "; ") + "rebuilding index: " + (IndexError ? IndexError : "unknown error");
+		}
+		sqlite3_free(IndexError);
+	}
+
+	sqlite3_exec(&Connection, ("PRAGMA journal_mode = " + State.JournalMode).c_str(), nullptr, nullptr, nullptr);
+	sqlite3_exec(&Connection, ("PRAGMA synchronous = " + std::to_string(State.Synchronous)).c_str(), nullptr, nullptr, nullptr);
+	sqlite3_exec(&Connection, ("PRAGMA cache_size = " + std::to_string(State.CacheSize)).c_str(), nullptr, nullptr, nullptr);
+
+	if (Check)
+	{
+		// checks the imported table and its indexes rather than the whole file
+		sqlite3_stmt* Statement = nullptr;
+		if (sqlite3_prepare_v2(&Connection, ("PRAGMA integrity_check(" + QuoteIdentifier(TableName) + ")").c_str(), -1, &Statement, nullptr) == SQLITE_OK)
+		{
+			while (sqlite3_step(Statement) == SQLITE_ROW)
+			{
+				const char* Result = reinterpret_cast<const char*>(sqlite3_column_text(Statement, 0));
+				if (Result && strcmp(Result, "ok") != 0)
+				{
+					ErrorMessage += std::string(ErrorMessage.empty() ? "" : "; ") + "integrity check: " + Result;
+				}
+			}
+		}
+		sqlite3_finalize(Statement);
+	}
+	return ErrorMessage;
+}
+
+void CsvImporter::StopParsers()
+{
+	mStopping = true;
+	for (auto& Parser : mParsers)
+	{
+		Parser.join();
+	}
+	mParsers.clear();
+}
+
+void CsvImporter::Finish(sqlite3& Connection, const char* ErrorMessage)
+{
+	// copied first: the message may belong to the connection the bulk load cleanup is about to use
+	std::string Message = ErrorMessage ? ErrorMessage : "";
+	StopParsers();
+
+	if (mBulkLoadState.Active)
+	{
+		const std::string CleanupError = EndBulkLoad(Connection, mTableName, mBulkLoadState, Message.empty());
+		Message += (Message.empty() || CleanupError.empty() ? "" : "; ") + CleanupError;
+		mBulkLoadState = BulkLoadState();
+	}
+
+	{
+		std::lock_guard<std::mutex> Lock(mMutex);
+		mErrorMessage = std::move(Message);
+	}
+	mFinished = true;
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include "SPSCRing.h"
+#include "../Serialisation/DataTable.h"
+#include "../Serialisation/MappedFile.h"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+struct sqlite3;
+class QueryExecutor;
+class StatementCache;
+
+// Streams a CSV file into a new table. The delimiter, header and column types are sniffed from a
+// sample of the file (see CSVSniffer), so the table is created before anything is parsed in full.
+// Parser threads then cut the file into batches and parse them into per-thread rings, while the
+// executor's worker, the only thread touching the connection, inserts them in file order, one
+// transaction per batch. Memory stays at a few batches per parser however large the file is, and
+// other queries still get the worker between batches, except during a bulk load. An existing
+// table is appended to instead of created, and its declared types apply to what is stored. When a
+// batch holds a column wider than the sample said, a table the import created is rebuilt with the
+// wider types before that batch goes in, as column affinity would otherwise coerce its cells
+// ("007" bound into an INTEGER column is stored as 7).
+class CsvImporter final : public std::enable_shared_from_this<CsvImporter>
+{
+public:
+
+	static constexpr size_t BatchRows = 65536;
+	// parsed batches each parser may run ahead of the writer
+	static constexpr size_t RingBatches = 2;
+
+	// Maps the file and queues the import; returns nullptr when the file can't be opened. The first
+	// record names the columns. Dropping the importer stops it after the batch in progress.
+	// Bulk load trades durability for speed while the import runs: the journal is kept in memory,
+	// syncs are skipped, the page cache grows, and the table's indexes are dropped and rebuilt
+	// once at the end. The settings are put back and the table is integrity-checked afterwards.
+	// The settings apply to the whole worker connection, so a bulk load holds the worker from
+	// start to finish and other queries wait until it is done or cancelled.
+	static std::shared_ptr<CsvImporter> Start(QueryExecutor& Executor, const std::string& FilePath, const std::string& TableName, bool BulkLoad);
+
+	CsvImporter(QueryExecutor& Executor, MappedFilePtr File, const std::string& TableName, bool BulkLoad);
+	~CsvImporter();
+
+	CsvImporter(const CsvImporter& copy) = delete;
+	CsvImporter(const CsvImporter&& Rhs) = delete;
+	CsvImporter& operator=(const CsvImporter& Rhs) = delete;
+	CsvImporter& operator=(const CsvImporter&& Rhs) = delete;
+
+	const std::string& GetTableName() const { return mTableName; }
+
+	bool IsFinished() const { return mFinished.load(); }
+	int64_t GetRowsImported() const { return mRowsImported.load(); }
+	// fraction of the file committed so far
+	float GetProgress() const;
+	std::string GetErrorMessage() const;
+
+	// throughput since the import started, and how many parsed batches are waiting for the writer
+	double GetRowsPerSecond() const;
+	double GetMegabytesPerSecond() const;
+	size_t GetQueuedBatches() const;
+	size_t GetQueueCapacity() const { return mRings.size() * RingBatches; }
+
+	// rows already committed stay in the table
+	void Cancel() { mCancelRequested.store(true); }
+
+private:
+
+	// connection settings and index definitions to put back after a bulk load
+	struct BulkLoadState
+	{
+		bool Active = false;
+		std::string JournalMode;
+		int Synchronous = 0;
+		int CacheSize = 0;
+		std::vector<std::string> IndexDefinitions;
+	};
+
+	struct ParsedBatch
+	{
+		size_t Sequence = 0;
+		TypedDataTablePtr Table;
+		size_t Rows = 0;
+		size_t End = 0;
+	};
+
+	using Clock = std::chrono::steady_clock;
+
+	// worker thread only
+	bool PrepareTable(StatementCache& Statements);
+	// folds a batch's column types into mColumnTypes, noting when the created table falls behind
+	void WidenTypes(const TypedDataTable& Batch);
+	// rebuilds the created table with mColumnTypes; returns an error message, empty on success
+	std::string ApplyWidenedTypes(sqlite3& Connection);
+	void BeginBulkLoad(sqlite3& Connection);
+	static std::string EndBulkLoad(sqlite3& Connection, const std::string& TableName, const BulkLoadState& State, bool Check);
+	bool ImportBatch(StatementCache& Statements);
+	bool InsertRows(StatementCache& Statements, const TypedDataTable& Batch, size_t Rows);
+	ParsedBatch* FindNextBatch(size_t& OutRing);
+
+	// parser threads
+	void ParserMain(size_t Ring);
+	ParsedBatch ParseBatch(size_t Start, size_t End) const;
+
+	void StopParsers();
+	void Finish(sqlite3& Connection, const char* ErrorMessage);
+
+	QueryExecutor& mExecutor;
+	const MappedFilePtr mFile;
+	const std::string mTableName;
+	const bool mBulkLoad;
+
+	std::atomic<bool> mFinished;
+	std::atomic<bool> mCancelRequested;
+	std::atomic<int64_t> mRowsImported;
+	std::atomic<size_t> mBytesImported;
+	const Clock::time_point mStartTime;
+
+	mutable std::mutex mMutex;
+	std::string mErrorMessage;
+
+	// set up by PrepareTable before the parsers start, then read-only
+	char mDelimiter = ',';
+	size_t mNumColumns = 0;
+	std::vector<std::string> mColumnNames;
+	std::string mInsertQuery;
+
+	// parsers take the next batch's byte range under the split lock, so sequence numbers follow
+	// the file; each parser's ring is in sequence order, and the writer takes whichever ring
+	// holds the next sequence at its front
+	std::mutex mSplitMutex;
+	size_t mSplitOffset = 0;
+	size_t mNextSequence = 0;
+	// created with the importer so the UI can read their sizes at any time
+	std::vector<std::unique_ptr<SPSCRing<ParsedBatch>>> mRings;
+	std::vector<std::thread> mParsers;
+	std::atomic<size_t> mParsersRunning;
+	std::atomic<bool> mStopping;
+
+	// worker thread only: the declared types, widened as batches disagree with the sample
+	std::vector<ColumnDataType> mColumnTypes;
+	bool mCreatedTable = false;
+	bool mTypesWidened = false;
+	size_t mNextToWrite = 0;
+	BulkLoadState mBulkLoadState;
+};
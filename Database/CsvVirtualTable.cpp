@@ -0,0 +1,458 @@
+#include "CsvVirtualTable.h"
+#include "../Serialisation/BinaryReader.h"
+#include "../Serialisation/CSVScanner.h"
+#include "../Serialisation/DataTable.h"
+#include "../Serialisation/MappedFile.h"
+#include "../sqlite/sqlite3.h"
+#include <algorithm>
+#include <limits>
+#include <math.h>
+#include <optional>
+#include <stdlib.h>
+
+namespace
+{
+	// idxNum bits for the rowid constraints xBestIndex hands to xFilter, in argv order
+	constexpr int RowidEquals = 1;
+	constexpr int RowidLowerBound = 2;
+	constexpr int RowidLowerExclusive = 4;
+	constexpr int RowidUpperBound = 8;
+	constexpr int RowidUpperExclusive = 16;
+
+	// the first row a lower bound on rowid admits, or the last row an upper bound does; SQLite still
+	// checks the constraints on every row, so a bound only has to be no tighter than the real one
+	long long FirstRowFrom(sqlite3_value* Value, bool Exclusive)
+	{
+		if (sqlite3_value_numeric_type(Value) == SQLITE_INTEGER)
+		{
+			const long long Bound = sqlite3_value_int64(Value);
+			return Exclusive && Bound < std::numeric_limits<long long>::max() ? Bound + 1 : Bound;
+		}
+		const double Bound = Exclusive ? floor(sqlite3_value_double(Value)) + 1.0 : ceil(sqlite3_value_double(Value));
+		return Bound >= 9.2e18 ? std::numeric_limits<long long>::max() : Bound <= -9.2e18 ? std::numeric_limits<long long>::min() : static_cast<long long>(Bound);
+	}
+
+	long long LastRowFrom(sqlite3_value* Value, bool Exclusive)
+	{
+		if (sqlite3_value_numeric_type(Value) == SQLITE_INTEGER)
+		{
+			const long long Bound = sqlite3_value_int64(Value);
+			return Exclusive && Bound > std::numeric_limits<long long>::min() ? Bound - 1 : Bound;
+		}
+		const double Bound = Exclusive ? ceil(sqlite3_value_double(Value)) - 1.0 : floor(sqlite3_value_double(Value));
+		return Bound >= 9.2e18 ? std::numeric_limits<long long>::max() : Bound <= -9.2e18 ? std::numeric_limits<long long>::min() : static_cast<long long>(Bound);
+	}
+
+	std::string QuoteIdentifier(const std::string& Name)
+	{
+		std::string Quoted = "\"";
+		for (const char Character : Name)
+		{
+			Quoted += Character;
+			if (Character == '"')
+			{
+				Quoted += '"';
+			}
+		}
+		Quoted += '"';
+		return Quoted;
+	}
+
+	// a module argument as written, without the quotes around an SQL string or identifier
+	std::string ArgumentText(const char* Argument)
+	{
+		std::string Text(Argument);
+		if (Text.size() >= 2 && (Text.front() == '\'' || Text.front() == '"') && Text.back() == Text.front())
+		{
+			const char Quote = Text.front();
+			std::string Unquoted;
+			for (size_t Index = 1; Index + 1 < Text.size(); ++Index)
+			{
+				Unquoted += Text[Index];
+				if (Text[Index] == Quote && Text[Index + 1] == Quote)
+				{
+					++Index;
+				}
+			}
+			return Unquoted;
+		}
+		return Text;
+	}
+
+	struct CsvMapTable : sqlite3_vtab
+	{
+		MappedFilePtr File;
+		const uint8_t* Data = nullptr;
+		size_t Length = 0;
+		std::vector<ColumnDataType> Types;
+		// where row N * CheckpointRows + 1 starts, filled in as scans pass each one
+		std::vector<size_t> Checkpoints;
+		double EstimatedRows = 0.0;
+	};
+
+	struct CsvMapCursor : sqlite3_vtab_cursor
+	{
+		std::optional<CSVScanner> Scanner;
+		size_t ScanStart = 0;
+		long long Row = 0;
+		long long LastRow = 0;
+		bool Eof = true;
+		uint64_t ColumnsUsed = ~uint64_t(0);
+		// views into the mapped file for the columns the query reads
+		std::vector<std::string_view> Fields;
+		std::string Scratch;
+	};
+
+	CsvMapTable& GetTable(sqlite3_vtab_cursor* Cursor)
+	{
+		return *static_cast<CsvMapTable*>(Cursor->pVtab);
+	}
+
+	bool IsColumnUsed(uint64_t ColumnsUsed, size_t Column)
+	{
+		// SQLite folds every column past the 63rd into the top bit
+		return ((ColumnsUsed >> std::min<size_t>(Column, 63)) & 1) != 0;
+	}
+
+	// Splits the next row, keeping the fields of used columns when Keep is set. Rows skipped on
+	// the way to a rowid only need their end found.
+	void ReadRow(CsvMapCursor& Cursor, bool Keep)
+	{
+		CsvMapTable& Table = GetTable(&Cursor);
+		const size_t RowStart = Cursor.ScanStart + Cursor.Scanner->GetPosition();
+		if (RowStart >= Table.Length)
+		{
+			Cursor.Eof = true;
+			return;
+		}
+
+		const long long RowIndex = Cursor.Row++;
+		if (RowIndex % CsvVirtualTable::CheckpointRows == 0 && size_t(RowIndex / CsvVirtualTable::CheckpointRows) == Table.Checkpoints.size())
+		{
+			Table.Checkpoints.push_back(RowStart);
+		}
+
+		if (Keep)
+		{
+			std::fill(Cursor.Fields.begin(), Cursor.Fields.end(), std::string_view());
+		}
+		std::string_view Field;
+		bool EndOfRow = false;
+		for (size_t Column = 0; !EndOfRow && Cursor.Scanner->NextField(Field, EndOfRow); ++Column)
+		{
+			if (Keep && Column < Cursor.Fields.size() && IsColumnUsed(Cursor.ColumnsUsed, Column))
+			{
+				Cursor.Fields[Column] = Field;
+			}
+		}
+	}
+
+	// positions the cursor on Row, starting from the last checkpoint at or before it
+	void SeekRow(CsvMapCursor& Cursor, long long Row)
+	{
+		CsvMapTable& Table = GetTable(&Cursor);
+		const size_t Checkpoint = std::min(size_t((Row - 1) / CsvVirtualTable::CheckpointRows), Table.Checkpoints.size() - 1);
+		Cursor.ScanStart = Table.Checkpoints[Checkpoint];
+		Cursor.Scanner.emplace(Table.Data + Cursor.ScanStart, Table.Length - Cursor.ScanStart);
+		Cursor.Row = static_cast<long long>(Checkpoint) * CsvVirtualTable::CheckpointRows;
+		Cursor.Eof = false;
+
+		while (!Cursor.Eof && Cursor.Row + 1 < Row)
+		{
+			ReadRow(Cursor, false);
+		}
+		if (!Cursor.Eof)
+		{
+			ReadRow(Cursor, true);
+		}
+	}
+
+	int Connect(sqlite3* Connection, void*, int ArgumentCount, const char* const* Arguments, sqlite3_vtab** OutTable, char** OutError)
+	{
+		if (ArgumentCount < 4)
+		{
+			*OutError = sqlite3_mprintf("csvmap: expected a file path, as in USING csvmap('file.csv')");
+			return SQLITE_ERROR;
+		}
+
+		const std::string FilePath = ArgumentText(Arguments[3]);
+		MappedFilePtr File = MappedFile::Open(FilePath);
+		if (!File || File->GetSize() == 0)
+		{
+			*OutError = sqlite3_mprintf("csvmap: can't read %s", FilePath.c_str());
+			return SQLITE_ERROR;
+		}
+
+		auto Table = std::make_unique<CsvMapTable>();
+		Table->Data = File->GetData();
+		Table->Length = File->GetSize();
+		Table->File = std::move(File);
+
+		std::vector<std::string> ColumnNames;
+		CSVScanner Scanner(Table->Data, Table->Length);
+		std::string_view Field;
+		bool EndOfRow = false;
+		std::string Scratch;
+		while (Scanner.NextField(Field, EndOfRow))
+		{
+			std::string Name(CSVScanner::Unquote(Field, Scratch));
+			if (Name.empty())
+			{
+				Name = "column" + std::to_string(ColumnNames.size() + 1);
+			}
+			// SQLite compares column names without case
+			while (std::any_of(ColumnNames.begin(), ColumnNames.end(), [&Name](const std::string& Column) { return sqlite3_stricmp(Column.c_str(), Name.c_str()) == 0; }))
+			{
+				Name += "_" + std::to_string(ColumnNames.size() + 1);
+			}
+			ColumnNames.push_back(std::move(Name));
+			if (EndOfRow)
+			{
+				break;
+			}
+		}
+
+		// the declared types come from a sample at the top; cells that don't fit are returned as text
+		const size_t SampleStart = Scanner.GetPosition();
+		const size_t SampleEnd = SampleStart + CSVScanner::FindRowsEnd(Table->Data + SampleStart, Table->Length - SampleStart, CsvVirtualTable::SampleRows);
+		TypedDataTablePtr Sample;
+		if (SampleEnd > SampleStart)
+		{
+			BinaryReader Reader(Table->Data + SampleStart, SampleEnd - SampleStart);
+			Sample = TypedDataTable::CreateFromCSV(Reader, 0, 0, nullptr, 1, ColumnNames.size());
+		}
+
+		std::string Schema = "CREATE TABLE x(";
+		for (size_t Column = 0; Column < ColumnNames.size(); ++Column)
+		{
+			const ColumnDataType Type = Sample ? Sample->GetColumnDataType(Column) : ColumnDataType::Unknown;
+			Table->Types.push_back(Type);
+			Schema += (Column > 0 ? ", " : "") + QuoteIdentifier(ColumnNames[Column]) + (Type == ColumnDataType::Unknown ? "" : std::string(" ") + TypedDataTable::GetColumnDataTypeName(Type));
+		}
+		Schema += ")";
+
+		const int Result = sqlite3_declare_vtab(Connection, Schema.c_str());
+		if (Result != SQLITE_OK)
+		{
+			*OutError = sqlite3_mprintf("csvmap: %s", sqlite3_errmsg(Connection));
+			return Result;
+		}
+
+		Table->Checkpoints.push_back(SampleStart);
+		const size_t SampleRows = Sample ? Sample->GetNumRows() : 0;
+		Table->EstimatedRows = SampleRows > 0 ? double(Table->Length - SampleStart) * SampleRows / double(SampleEnd - SampleStart) : 1.0;
+		*OutTable = Table.release();
+		return SQLITE_OK;
+	}
+
+	int Disconnect(sqlite3_vtab* Table)
+	{
+		delete static_cast<CsvMapTable*>(Table);
+		return SQLITE_OK;
+	}
+
+	int BestIndex(sqlite3_vtab* VirtualTable, sqlite3_index_info* Info)
+	{
+		const CsvMapTable& Table = *static_cast<CsvMapTable*>(VirtualTable);
+		int Plan = 0;
+		int Equals = -1;
+		int Lower = -1;
+		int Upper = -1;
+		for (int Index = 0; Index < Info->nConstraint; ++Index)
+		{
+			const auto& Constraint = Info->aConstraint[Index];
+			if (!Constraint.usable || Constraint.iColumn != -1)
+			{
+				continue;
+			}
+			switch (Constraint.op)
+			{
+			case SQLITE_INDEX_CONSTRAINT_EQ:
+				Equals = Index;
+				break;
+			case SQLITE_INDEX_CONSTRAINT_GT:
+			case SQLITE_INDEX_CONSTRAINT_GE:
+				Lower = Index;
+				break;
+			case SQLITE_INDEX_CONSTRAINT_LT:
+			case SQLITE_INDEX_CONSTRAINT_LE:
+				Upper = Index;
+				break;
+			}
+		}
+
+		double Rows = Table.EstimatedRows;
+		int Argument = 0;
+		if (Equals >= 0)
+		{
+			Plan = RowidEquals;
+			Info->aConstraintUsage[Equals].argvIndex = ++Argument;
+			Info->idxFlags = SQLITE_INDEX_SCAN_UNIQUE;
+			Rows = 1.0;
+		}
+		else
+		{
+			if (Lower >= 0)
+			{
+				Plan |= RowidLowerBound | (Info->aConstraint[Lower].op == SQLITE_INDEX_CONSTRAINT_GT ? RowidLowerExclusive : 0);
+				Info->aConstraintUsage[Lower].argvIndex = ++Argument;
+				Rows /= 2.0;
+			}
+			if (Upper >= 0)
+			{
+				Plan |= RowidUpperBound | (Info->aConstraint[Upper].op == SQLITE_INDEX_CONSTRAINT_LT ? RowidUpperExclusive : 0);
+				Info->aConstraintUsage[Upper].argvIndex = ++Argument;
+				Rows /= 2.0;
+			}
+		}
+
+		// a lookup still walks up to a checkpoint's worth of rows to reach its row
+		Info->idxNum = Plan;
+		Info->estimatedRows = static_cast<sqlite3_int64>(std::max(Rows, 1.0));
+		Info->estimatedCost = Rows + ((Plan & (RowidEquals | RowidLowerBound)) ? CsvVirtualTable::CheckpointRows : 0);
+		Info->idxStr = sqlite3_mprintf("%llx", static_cast<unsigned long long>(Info->colUsed));
+		Info->needToFreeIdxStr = 1;
+		if (Info->nOrderBy == 1 && Info->aOrderBy[0].iColumn == -1 && !Info->aOrderBy[0].desc)
+		{
+			Info->orderByConsumed = 1;
+		}
+		return SQLITE_OK;
+	}
+
+	int Open(sqlite3_vtab* Table, sqlite3_vtab_cursor** OutCursor)
+	{
+		auto Cursor = new CsvMapCursor();
+		Cursor->Fields.resize(static_cast<CsvMapTable*>(Table)->Types.size());
+		*OutCursor = Cursor;
+		return SQLITE_OK;
+	}
+
+	int Close(sqlite3_vtab_cursor* Cursor)
+	{
+		delete static_cast<CsvMapCursor*>(Cursor);
+		return SQLITE_OK;
+	}
+
+	int Filter(sqlite3_vtab_cursor* VirtualCursor, int Plan, const char* ColumnsUsed, int ArgumentCount, sqlite3_value** Arguments)
+	{
+		CsvMapCursor& Cursor = *static_cast<CsvMapCursor*>(VirtualCursor);
+		Cursor.ColumnsUsed = ColumnsUsed ? strtoull(ColumnsUsed, nullptr, 16) : ~uint64_t(0);
+
+		long long FirstRow = 1;
+		Cursor.LastRow = std::numeric_limits<long long>::max();
+		int Argument = 0;
+		if ((Plan & RowidEquals) && Argument < ArgumentCount)
+		{
+			FirstRow = FirstRowFrom(Arguments[Argument], false);
+			Cursor.LastRow = LastRowFrom(Arguments[Argument++], false);
+		}
+		if ((Plan & RowidLowerBound) && Argument < ArgumentCount)
+		{
+			FirstRow = FirstRowFrom(Arguments[Argument++], (Plan & RowidLowerExclusive) != 0);
+		}
+		if ((Plan & RowidUpperBound) && Argument < ArgumentCount)
+		{
+			Cursor.LastRow = LastRowFrom(Arguments[Argument++], (Plan & RowidUpperExclusive) != 0);
+		}
+
+		FirstRow = std::max(FirstRow, 1ll);
+		if (FirstRow > Cursor.LastRow)
+		{
+			Cursor.Eof = true;
+			return SQLITE_OK;
+		}
+		SeekRow(Cursor, FirstRow);
+		return SQLITE_OK;
+	}
+
+	int Next(sqlite3_vtab_cursor* VirtualCursor)
+	{
+		CsvMapCursor& Cursor = *static_cast<CsvMapCursor*>(VirtualCursor);
+		if (Cursor.Row >= Cursor.LastRow)
+		{
+			Cursor.Eof = true;
+			return SQLITE_OK;
+		}
+		ReadRow(Cursor, true);
+		return SQLITE_OK;
+	}
+
+	int Eof(sqlite3_vtab_cursor* Cursor)
+	{
+		return static_cast<CsvMapCursor*>(Cursor)->Eof;
+	}
+
+	// cells are parsed here, so a query only pays for the columns it reads
+	int Column(sqlite3_vtab_cursor* VirtualCursor, sqlite3_context* Context, int ColumnIndex)
+	{
+		CsvMapCursor& Cursor = *static_cast<CsvMapCursor*>(VirtualCursor);
+		if (ColumnIndex < 0 || size_t(ColumnIndex) >= Cursor.Fields.size() || Cursor.Fields[ColumnIndex].empty())
+		{
+			sqlite3_result_null(Context);
+			return SQLITE_OK;
+		}
+
+		const std::string_view Raw = Cursor.Fields[ColumnIndex];
+		const std::string_view Text = CSVScanner::Unquote(Raw, Cursor.Scratch);
+		switch (GetTable(VirtualCursor).Types[ColumnIndex])
+		{
+		case ColumnDataType::Unknown:
+		case ColumnDataType::Integer:
+		{
+			int64_t Value = 0;
+			if (TypedDataTable::ParseInteger(Text, Value))
+			{
+				sqlite3_result_int64(Context, Value);
+				return SQLITE_OK;
+			}
+			[[fallthrough]];
+		}
+		case ColumnDataType::Real:
+		{
+			double Value = 0.0;
+			if (TypedDataTable::ParseReal(Text, Value))
+			{
+				sqlite3_result_double(Context, Value);
+				return SQLITE_OK;
+			}
+			[[fallthrough]];
+		}
+		default:
+			// views into the mapping stay valid for the table's lifetime; the scratch copy doesn't
+			sqlite3_result_text(Context, Text.data(), static_cast<int>(Text.size()), Text.data() == Cursor.Scratch.data() ? SQLITE_TRANSIENT : SQLITE_STATIC);
+			return SQLITE_OK;
+		}
+	}
+
+	int Rowid(sqlite3_vtab_cursor* Cursor, sqlite3_int64* OutRowid)
+	{
+		*OutRowid = static_cast<CsvMapCursor*>(Cursor)->Row;
+		return SQLITE_OK;
+	}
+
+	sqlite3_module MakeModule()
+	{
+		sqlite3_module Module = {};
+		Module.iVersion = 1;
+		Module.xCreate = &Connect;
+		Module.xConnect = &Connect;
+		Module.xBestIndex = &BestIndex;
+		Module.xDisconnect = &Disconnect;
+		Module.xDestroy = &Disconnect;
+		Module.xOpen = &Open;
+		Module.xClose = &Close;
+		Module.xFilter = &Filter;
+		Module.xNext = &Next;
+		Module.xEof = &Eof;
+		Module.xColumn = &Column;
+		Module.xRowid = &Rowid;
+		return Module;
+	}
+
+	const sqlite3_module CsvMapModule = MakeModule();
+}
+
+bool CsvVirtualTable::Register(sqlite3& Connection)
+{
+	return sqlite3_create_module(&Connection, "csvmap", &CsvMapModule, nullptr) == SQLITE_OK;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+struct sqlite3;
+
+// The csvmap module: CREATE VIRTUAL TABLE t USING csvmap('file.csv') queries a CSV file in place.
+// The file is memory-mapped and only the header and a sample of rows are read up front, which
+// give the column names and declared types. Rows are split as a scan reaches them, and a cell is
+// only parsed when a query reads its column. Every CheckpointRows rows the scan records where the
+// row starts, so a rowid lookup or range starts from the nearest known row instead of the top.
+// Rowids are row numbers from 1. The table is read-only.
+class CsvVirtualTable final
+{
+public:
+
+	static constexpr long long CheckpointRows = 1024;
+	// rows typed by the parser to pick each column's declared type
+	static constexpr long long SampleRows = 1000;
+
+	// makes csvmap available on Connection; false if SQLite refused the module
+	static bool Register(sqlite3& Connection);
+};
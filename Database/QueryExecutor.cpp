@@ -0,0 +1,495 @@
+#include "QueryExecutor.h"
+#include "ResultCursor.h"
+#include "../sqlite/sqlite3.h"
+#include <algorithm>
+
+namespace
+{
+	// VM instructions between progress callbacks; small enough that a cancel lands within milliseconds
+	constexpr int ProgressInterval = 1000;
+	constexpr double RateSampleSeconds = 0.25;
+	// rows the background count steps before yielding to page requests and new queries
+	constexpr int64_t CountChunkRows = 65536;
+	// statements whose rows stay browsable after a script; later result sets only report counts
+	constexpr size_t MaxResultCursors = 32;
+}
+
+QueryTicket::QueryTicket(std::string Query, bool SingleTransaction)
+	: mQuery(std::move(Query))
+	, mSingleTransaction(SingleTransaction)
+	, mState(QueryState::Queued)
+	, mStatementsRun(0)
+	, mCancelRequested(false)
+	, mVMSteps(0)
+	, mVMStepsPerSecond(0.0)
+{
+}
+
+bool QueryTicket::IsFinished() const
+{
+	const auto State = GetState();
+	return State == QueryState::Complete || State == QueryState::Failed || State == QueryState::Cancelled;
+}
+
+double QueryTicket::GetElapsedSeconds() const
+{
+	std::lock_guard<std::mutex> Lock(mMutex);
+	switch (GetState())
+	{
+	case QueryState::Queued:
+		return 0.0;
+	case QueryState::Running:
+		return std::chrono::duration<double>(Clock::now() - mStartTime).count();
+	default:
+		return std::chrono::duration<double>(mEndTime - mStartTime).count();
+	}
+}
+
+std::vector<StatementResult> QueryTicket::GetStatementResults() const
+{
+	std::lock_guard<std::mutex> Lock(mMutex);
+	return mResults;
+}
+
+std::string QueryTicket::GetErrorMessage() const
+{
+	std::lock_guard<std::mutex> Lock(mMutex);
+	return mErrorMessage;
+}
+
+void QueryTicket::MarkRunning()
+{
+	std::lock_guard<std::mutex> Lock(mMutex);
+	mStartTime = Clock::now();
+	mRateSampleTime = mStartTime;
+	mState = QueryState::Running;
+}
+
+void QueryTicket::MarkFinished(std::vector<StatementResult> Results, std::string ErrorMessage)
+{
+	std::lock_guard<std::mutex> Lock(mMutex);
+	mEndTime = Clock::now();
+	if (ErrorMessage.empty())
+	{
+		mState = QueryState::Complete;
+	}
+	else
+	{
+		mState = IsCancelRequested() ? QueryState::Cancelled : QueryState::Failed;
+	}
+	mResults = std::move(Results);
+	mErrorMessage = std::move(ErrorMessage);
+	mVMStepsPerSecond = 0.0;
+}
+
+void QueryTicket::MarkCancelled()
+{
+	std::lock_guard<std::mutex> Lock(mMutex);
+	mStartTime = mEndTime = Clock::now();
+	mState = QueryState::Cancelled;
+}
+
+void QueryTicket::AddVMSteps(uint64_t Steps)
+{
+	const auto Total = mVMSteps += Steps;
+	const auto Now = Clock::now();
+	const double SampleSeconds = std::chrono::duration<double>(Now - mRateSampleTime).count();
+	if (SampleSeconds >= RateSampleSeconds)
+	{
+		mVMStepsPerSecond = static_cast<double>(Total - mRateSampleSteps) / SampleSeconds;
+		mRateSampleSteps = Total;
+		mRateSampleTime = Now;
+	}
+}
+
+QueryExecutor::QueryExecutor(sqlite3& Connection, bool OwnsConnection)
+	: mConnection(Connection)
+	, mOwnsConnection(OwnsConnection)
+	, mStatements(Connection)
+	, mRunningTicket(nullptr)
+	, mWorker(&QueryExecutor::WorkerMain, this)
+{
+	sqlite3_progress_handler(&mConnection, ProgressInterval, &QueryExecutor::ProgressCallback, this);
+}
+
+QueryExecutor::~QueryExecutor()
+{
+	{
+		std::lock_guard<std::mutex> Lock(mMutex);
+		mStopping = true;
+		// anyone still holding a queued ticket sees it finish rather than wait forever
+		for (const auto& Ticket : mPending)
+		{
+			Ticket->mCancelRequested = true;
+			Ticket->MarkCancelled();
+		}
+		mPending.clear();
+		mBackgroundTasks.clear();
+		// an interrupt that lands between two statements of a script is lost, the flag isn't
+		if (mRunning)
+		{
+			mRunning->mCancelRequested = true;
+		}
+	}
+	mWakeWorker.notify_all();
+	sqlite3_interrupt(&mConnection);
+	mWorker.join();
+
+	// tasks still queued may be cleanup from components already torn down, so they run here
+	// rather than being dropped; nothing else touches the connection any more. A task may post
+	// more, so each round runs from a local queue until none are left.
+	std::deque<QueuedTask> Leftover;
+	{
+		std::lock_guard<std::mutex> Lock(mMutex);
+		Leftover.swap(mTasks);
+	}
+	if (!Leftover.empty())
+	{
+		ParkCursors();
+	}
+	while (!Leftover.empty())
+	{
+		for (QueuedTask& Queued : Leftover)
+		{
+			Queued.Work(mStatements);
+		}
+		Leftover.clear();
+
+		std::lock_guard<std::mutex> Lock(mMutex);
+		Leftover.swap(mTasks);
+	}
+
+	// cursors the UI still holds keep their resident pages but must let go of the connection
+	for (auto& Cursor : mCursors)
+	{
+		if (auto Live = Cursor.lock())
+		{
+			Live->Close();
+		}
+	}
+
+	mStatements.Clear();
+	sqlite3_progress_handler(&mConnection, 0, nullptr, nullptr);
+	if (mOwnsConnection)
+	{
+		sqlite3_close(&mConnection);
+	}
+}
+
+std::shared_ptr<QueryTicket> QueryExecutor::Submit(const std::string& Query, bool SingleTransaction)
+{
+	auto Ticket = std::make_shared<QueryTicket>(Query, SingleTransaction);
+	{
+		std::lock_guard<std::mutex> Lock(mMutex);
+		mPending.push_back(Ticket);
+	}
+	mWakeWorker.notify_one();
+	return Ticket;
+}
+
+void QueryExecutor::Cancel(const std::shared_ptr<QueryTicket>& Ticket)
+{
+	if (!Ticket)
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> Lock(mMutex);
+	const auto Queued = std::find(mPending.begin(), mPending.end(), Ticket);
+	if (Queued != mPending.end())
+	{
+		mPending.erase(Queued);
+		Ticket->mCancelRequested = true;
+		Ticket->MarkCancelled();
+	}
+	else if (Ticket == mRunning)
+	{
+		Ticket->mCancelRequested = true;
+		sqlite3_interrupt(&mConnection);
+	}
+}
+
+void QueryExecutor::RequestPage(const std::shared_ptr<ResultCursor>& Cursor, int64_t PageIndex)
+{
+	{
+		std::lock_guard<std::mutex> Lock(mMutex);
+		mPageRequests.emplace_back(Cursor, PageIndex);
+	}
+	mWakeWorker.notify_one();
+}
+
+void QueryExecutor::Post(Task Work)
+{
+	{
+		std::lock_guard<std::mutex> Lock(mMutex);
+		mTasks.push_back({ std::move(Work), false });
+	}
+	mWakeWorker.notify_one();
+}
+
+void QueryExecutor::PostExclusive(Task Work)
+{
+	{
+		std::lock_guard<std::mutex> Lock(mMutex);
+		mTasks.push_back({ std::move(Work), true });
+	}
+	mWakeWorker.notify_one();
+}
+
+void QueryExecutor::PostBackground(BackgroundTask Work)
+{
+	{
+		std::lock_guard<std::mutex> Lock(mMutex);
+		mBackgroundTasks.push_back(std::move(Work));
+	}
+	mWakeWorker.notify_one();
+}
+
+int QueryExecutor::ProgressCallback(void* Context)
+{
+	auto* Executor = static_cast<QueryExecutor*>(Context);
+	QueryTicket* Ticket = Executor->mRunningTicket.load();
+	if (!Ticket)
+	{
+		return 0;
+	}
+
+	Ticket->AddVMSteps(ProgressInterval);
+	return Ticket->IsCancelRequested() ? 1 : 0;
+}
+
+void QueryExecutor::WorkerMain()
+{
+	for (;;)
+	{
+		std::shared_ptr<QueryTicket> Ticket;
+		std::shared_ptr<ResultCursor> Cursor;
+		int64_t PageIndex = -1;
+		QueuedTask Work;
+		BackgroundTask Background;
+		{
+			std::unique_lock<std::mutex> Lock(mMutex);
+			mWakeWorker.wait(Lock, [this] { return mStopping || !mPending.empty() || !mPageRequests.empty() || !mTasks.empty() || !mCountQueue.empty() || !mBackgroundTasks.empty(); });
+			if (mStopping)
+			{
+				return;
+			}
+
+			if (!mPageRequests.empty())
+			{
+				Cursor = mPageRequests.front().first.lock();
+				PageIndex = mPageRequests.front().second;
+				mPageRequests.pop_front();
+			}
+			else if (!mTasks.empty())
+			{
+				Work = std::move(mTasks.front());
+				mTasks.pop_front();
+			}
+			else if (!mPending.empty())
+			{
+				Ticket = std::move(mPending.front());
+				mPending.pop_front();
+				mRunning = Ticket;
+				Ticket->MarkRunning();
+			}
+			else if (!mCountQueue.empty())
+			{
+				Cursor = mCountQueue.front().lock();
+				mCountQueue.pop_front();
+			}
+			else
+			{
+				Background = std::move(mBackgroundTasks.front());
+				mBackgroundTasks.pop_front();
+			}
+		}
+
+		if (Work.Exclusive || Ticket)
+		{
+			ParkCursors();
+		}
+
+		if (Work.Work)
+		{
+			Work.Work(mStatements);
+		}
+		else if (Background)
+		{
+			if (Background(mStatements))
+			{
+				std::lock_guard<std::mutex> Lock(mMutex);
+				mBackgroundTasks.push_back(std::move(Background));
+			}
+		}
+		else if (Ticket)
+		{
+			mRunningTicket = Ticket.get();
+			RunTicket(*Ticket);
+			mRunningTicket = nullptr;
+
+			std::lock_guard<std::mutex> Lock(mMutex);
+			mRunning.reset();
+		}
+		else if (Cursor && PageIndex >= 0)
+		{
+			Cursor->FetchRequestedPage(PageIndex);
+		}
+		else if (Cursor && Cursor->CountRows(CountChunkRows))
+		{
+			std::lock_guard<std::mutex> Lock(mMutex);
+			mCountQueue.push_back(Cursor);
+		}
+	}
+}
+
+void QueryExecutor::ParkCursors()
+{
+	std::vector<std::shared_ptr<ResultCursor>> Live;
+	{
+		std::lock_guard<std::mutex> Lock(mMutex);
+		for (const auto& Cursor : mCursors)
+		{
+			if (auto Locked = Cursor.lock())
+			{
+				Live.push_back(std::move(Locked));
+			}
+		}
+	}
+	for (const auto& Cursor : Live)
+	{
+		Cursor->Park();
+	}
+}
+
+void QueryExecutor::RunTicket(QueryTicket& Ticket)
+{
+	std::vector<StatementResult> Results;
+	std::string ErrorMessage;
+	size_t KeptCursors = 0;
+
+	if (Ticket.IsSingleTransaction() && sqlite3_exec(&mConnection, "BEGIN", nullptr, nullptr, nullptr) != SQLITE_OK)
+	{
+		ErrorMessage = sqlite3_errmsg(&mConnection);
+	}
+
+	// statements run in order until one fails; each is prepared only once its predecessors have
+	// run, so scripts can use the tables they create
+	const char* Query = Ticket.GetQuery().c_str();
+	const char* Sql = Query;
+	while (Sql[0] && ErrorMessage.empty())
+	{
+		// statements too short to reach the progress handler still stop a cancelled script
+		if (Ticket.IsCancelRequested())
+		{
+			ErrorMessage = "interrupted";
+			break;
+		}
+
+		const auto StartTime = std::chrono::steady_clock::now();
+
+		StatementResult Result;
+		sqlite3_stmt* Statement = nullptr;
+		const char* Tail = nullptr;
+		if (!mStatements.AcquireNext(Sql, Statement, Tail))
+		{
+			Result.ErrorMessage = sqlite3_errmsg(&mConnection);
+		}
+		else if (Statement)
+		{
+			Result = RunStatement(*Statement, KeptCursors < MaxResultCursors);
+			KeptCursors += Result.Rows ? 1 : 0;
+		}
+		else
+		{
+			// whitespace or a trailing comment
+			Sql = Tail;
+			continue;
+		}
+
+		Result.SqlOffset = Sql - Query;
+		Result.SqlLength = Tail - Sql;
+		Result.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - StartTime).count();
+		ErrorMessage = Result.ErrorMessage;
+		Results.push_back(std::move(Result));
+		Ticket.mStatementsRun++;
+		Sql = Tail;
+	}
+
+	if (Ticket.IsSingleTransaction() && !sqlite3_get_autocommit(&mConnection))
+	{
+		const char* Finish = ErrorMessage.empty() ? "COMMIT" : "ROLLBACK";
+		if (sqlite3_exec(&mConnection, Finish, nullptr, nullptr, nullptr) != SQLITE_OK && ErrorMessage.empty())
+		{
+			ErrorMessage = sqlite3_errmsg(&mConnection);
+		}
+	}
+
+	if (!ErrorMessage.empty())
+	{
+		// rows from a failed or rolled back script can't be trusted
+		for (auto& Result : Results)
+		{
+			Result.Rows.reset();
+		}
+	}
+
+	std::lock_guard<std::mutex> Lock(mMutex);
+	mCursors.erase(std::remove_if(mCursors.begin(), mCursors.end(), [](const std::weak_ptr<ResultCursor>& Entry) { return Entry.expired(); }), mCursors.end());
+	for (const auto& Result : Results)
+	{
+		if (Result.Rows)
+		{
+			mCursors.push_back(Result.Rows);
+			if (!Result.Rows->IsRowCountKnown())
+			{
+				mCountQueue.push_back(Result.Rows);
+			}
+		}
+	}
+	Ticket.MarkFinished(std::move(Results), std::move(ErrorMessage));
+}
+
+StatementResult QueryExecutor::RunStatement(sqlite3_stmt& Statement, bool KeepRows)
+{
+	StatementResult Result;
+	const int ChangesBefore = sqlite3_total_changes(&mConnection);
+
+	if (sqlite3_column_count(&Statement) == 0)
+	{
+		// no rows to show, so skip the cursor entirely; this is the hot path for large scripts
+		int ReturnCode = sqlite3_step(&Statement);
+		while (ReturnCode == SQLITE_ROW)
+		{
+			ReturnCode = sqlite3_step(&Statement);
+		}
+		if (ReturnCode != SQLITE_DONE)
+		{
+			Result.ErrorMessage = sqlite3_errmsg(&mConnection);
+		}
+		mStatements.Release(&Statement);
+	}
+	else
+	{
+		auto Cursor = std::make_shared<ResultCursor>(Statement, *this, mStatements);
+
+		// anything that writes runs to completion now rather than whenever the grid scrolls
+		int64_t PageIndex = 0;
+		bool Fetched = Cursor->FetchPage(PageIndex);
+		while (Fetched && !Cursor->mReadOnly && !Cursor->IsRowCountKnown())
+		{
+			Fetched = Cursor->FetchPage(++PageIndex);
+		}
+
+		Result.ErrorMessage = Cursor->GetErrorMessage();
+		if (Result.ErrorMessage.empty() && KeepRows)
+		{
+			// later statements in the script may drop what this one reads
+			Cursor->Park();
+			Result.Rows = std::move(Cursor);
+		}
+	}
+
+	Result.Changes = sqlite3_total_changes(&mConnection) - ChangesBefore;
+	return Result;
+}
@@ -0,0 +1,179 @@
+#pragma once
+
+#include "StatementCache.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct sqlite3;
+struct sqlite3_stmt;
+class ResultCursor;
+
+enum class QueryState
+{
+	Queued,
+	Running,
+	Complete,
+	Failed,
+	Cancelled,
+};
+
+// Outcome of one statement in a script. Statements that return columns keep a cursor over
+// their rows; the rest only report how many rows they changed.
+struct StatementResult
+{
+	// the statement's span within the ticket's query text
+	size_t SqlOffset = 0;
+	size_t SqlLength = 0;
+
+	std::shared_ptr<ResultCursor> Rows;
+	int64_t Changes = 0;
+	double Seconds = 0.0;
+	std::string ErrorMessage;
+};
+
+// Shared between the UI and the executor's worker thread; the worker is the only writer.
+class QueryTicket final
+{
+public:
+
+	QueryTicket(std::string Query, bool SingleTransaction);
+
+	QueryTicket(const QueryTicket& copy) = delete;
+	QueryTicket(const QueryTicket&& Rhs) = delete;
+	QueryTicket& operator=(const QueryTicket& Rhs) = delete;
+	QueryTicket& operator=(const QueryTicket&& Rhs) = delete;
+
+	const std::string& GetQuery() const { return mQuery; }
+	bool IsSingleTransaction() const { return mSingleTransaction; }
+	QueryState GetState() const { return mState.load(); }
+	bool IsFinished() const;
+	bool IsCancelRequested() const { return mCancelRequested.load(); }
+	double GetElapsedSeconds() const;
+
+	// sampled by the progress handler while the statement runs
+	uint64_t GetVMSteps() const { return mVMSteps.load(); }
+	double GetVMStepsPerSecond() const { return mVMStepsPerSecond.load(); }
+
+	// statements finished so far; the script stops at the first one that fails
+	size_t GetStatementsRun() const { return mStatementsRun.load(); }
+
+	// one entry per statement run, in script order; each cursor's first page is resident once
+	// the ticket finishes
+	std::vector<StatementResult> GetStatementResults() const;
+	std::string GetErrorMessage() const;
+
+private:
+
+	friend class QueryExecutor;
+
+	using Clock = std::chrono::steady_clock;
+
+	void MarkRunning();
+	void MarkFinished(std::vector<StatementResult> Results, std::string ErrorMessage);
+	void MarkCancelled();
+	void AddVMSteps(uint64_t Steps);
+
+	const std::string mQuery;
+	const bool mSingleTransaction;
+	std::atomic<QueryState> mState;
+	std::atomic<size_t> mStatementsRun;
+	std::atomic<bool> mCancelRequested;
+	std::atomic<uint64_t> mVMSteps;
+	std::atomic<double> mVMStepsPerSecond;
+
+	// worker-only bookkeeping for the steps per second estimate
+	Clock::time_point mRateSampleTime;
+	uint64_t mRateSampleSteps = 0;
+
+	mutable std::mutex mMutex;
+	Clock::time_point mStartTime;
+	Clock::time_point mEndTime;
+	std::vector<StatementResult> mResults;
+	std::string mErrorMessage;
+};
+
+// Runs queries one at a time on a worker thread so the UI frame never waits on SQLite.
+// The worker also services page fetches for the cursors it hands out, ahead of new queries,
+// and counts their rows in the background when it would otherwise be idle.
+class QueryExecutor final
+{
+public:
+
+	QueryExecutor(sqlite3& Connection, bool OwnsConnection);
+	~QueryExecutor();
+
+	QueryExecutor(const QueryExecutor& copy) = delete;
+	QueryExecutor(const QueryExecutor&& Rhs) = delete;
+	QueryExecutor& operator=(const QueryExecutor& Rhs) = delete;
+	QueryExecutor& operator=(const QueryExecutor&& Rhs) = delete;
+
+	// runs every statement in Query in order, optionally wrapped in one transaction that is
+	// rolled back if any statement fails
+	std::shared_ptr<QueryTicket> Submit(const std::string& Query, bool SingleTransaction = false);
+
+	// queued tickets are dropped; a running one is interrupted at its next progress callback
+	void Cancel(const std::shared_ptr<QueryTicket>& Ticket);
+
+	void RequestPage(const std::shared_ptr<ResultCursor>& Cursor, int64_t PageIndex);
+
+	// Work for other components that needs the worker connection. Tasks run ahead of queued
+	// queries; background tasks run when the worker is otherwise idle and are requeued for as
+	// long as they return true, so long jobs should do a bounded chunk per call. Anything that
+	// changes the schema belongs in an exclusive task, which runs after open cursors have been
+	// parked; plain tasks leave cursors where they are, so reads and statement releases don't cost
+	// the cursors their position or their row count. Tasks still queued when the executor is
+	// destroyed run before the connection closes.
+	using Task = std::function<void(StatementCache&)>;
+	using BackgroundTask = std::function<bool(StatementCache&)>;
+	void Post(Task Work);
+	void PostExclusive(Task Work);
+	void PostBackground(BackgroundTask Work);
+
+	const StatementCache& GetStatementCache() const { return mStatements; }
+
+private:
+
+	struct QueuedTask
+	{
+		Task Work;
+		bool Exclusive = false;
+	};
+
+	static int ProgressCallback(void* Context);
+
+	void WorkerMain();
+	// resets the statements of cursors left part way through, before a ticket or exclusive task,
+	// either of which may change the schema
+	void ParkCursors();
+	void RunTicket(QueryTicket& Ticket);
+	StatementResult RunStatement(sqlite3_stmt& Statement, bool KeepRows);
+
+	sqlite3& mConnection;
+	const bool mOwnsConnection;
+	StatementCache mStatements;
+
+	std::mutex mMutex;
+	std::condition_variable mWakeWorker;
+	std::deque<std::shared_ptr<QueryTicket>> mPending;
+	std::shared_ptr<QueryTicket> mRunning;
+	std::deque<std::pair<std::weak_ptr<ResultCursor>, int64_t>> mPageRequests;
+	std::deque<std::weak_ptr<ResultCursor>> mCountQueue;
+	std::deque<QueuedTask> mTasks;
+	std::deque<BackgroundTask> mBackgroundTasks;
+	std::vector<std::weak_ptr<ResultCursor>> mCursors;
+	bool mStopping = false;
+
+	// read by the progress handler, which may fire on the UI thread when the connection is shared
+	std::atomic<QueryTicket*> mRunningTicket;
+
+	std::thread mWorker;
+};
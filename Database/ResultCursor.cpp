@@ -0,0 +1,291 @@
+#include "ResultCursor.h"
+#include "QueryExecutor.h"
+#include "StatementCache.h"
+#include "../sqlite/sqlite3.h"
+#include <algorithm>
+#include <stdlib.h>
+
+ResultCursor::ResultCursor(sqlite3_stmt& Statement, QueryExecutor& Executor, StatementCache& Statements)
+	: mKnownRows(0)
+	, mRowCountKnown(false)
+	, mExecutor(&Executor)
+	, mStatements(&Statements)
+	, mStatement(&Statement)
+	, mReadOnly(sqlite3_stmt_readonly(&Statement) != 0)
+{
+	const int NumColumns = sqlite3_column_count(&Statement);
+	mColumnNames.reserve(NumColumns);
+	for (int Column = 0; Column < NumColumns; ++Column)
+	{
+		const char* Name = sqlite3_column_name(&Statement, Column);
+		mColumnNames.emplace_back(Name ? Name : "");
+	}
+}
+
+ResultCursor::~ResultCursor()
+{
+	// The last reference is usually dropped on the UI thread, which must never wait on the worker
+	// connection, so the statements go back to the cache on the worker. Once the executor has
+	// closed the cursor there is nothing left to release.
+	if (mExecutor && mStatements)
+	{
+		mExecutor->Post([Statement = mStatement, CountStatement = mCountStatement](StatementCache& Statements)
+		{
+			Statements.Release(CountStatement);
+			Statements.Release(Statement);
+		});
+	}
+}
+
+ResultPagePtr ResultCursor::GetPage(int64_t PageIndex)
+{
+	std::lock_guard<std::mutex> Lock(mMutex);
+	mLastRequestedPage = PageIndex;
+
+	const auto Resident = mResidentPages.find(PageIndex);
+	if (Resident != mResidentPages.end())
+	{
+		return Resident->second;
+	}
+
+	if (mRowCountKnown && PageIndex * PageSize >= mKnownRows)
+	{
+		return nullptr;
+	}
+
+	if (mExecutor && std::find(mRequestedPages.begin(), mRequestedPages.end(), PageIndex) == mRequestedPages.end())
+	{
+		mRequestedPages.push_back(PageIndex);
+		mExecutor->RequestPage(shared_from_this(), PageIndex);
+	}
+	return nullptr;
+}
+
+std::string ResultCursor::GetErrorMessage() const
+{
+	std::lock_guard<std::mutex> Lock(mMutex);
+	return mErrorMessage;
+}
+
+bool ResultCursor::FetchPage(int64_t PageIndex)
+{
+	{
+		std::lock_guard<std::mutex> Lock(mMutex);
+		mRequestedPages.erase(std::remove(mRequestedPages.begin(), mRequestedPages.end(), PageIndex), mRequestedPages.end());
+		if (mResidentPages.count(PageIndex))
+		{
+			return true;
+		}
+	}
+
+	if (!mStatement || !StepTo(PageIndex * PageSize))
+	{
+		return false;
+	}
+
+	auto Page = std::make_shared<ResultPage>(mStepRow, GetColumns());
+	Page->Rows.Reserve(PageSize);
+
+	bool Succeeded = true;
+	while (Page->Rows.GetRows() < PageSize)
+	{
+		const int ReturnCode = sqlite3_step(mStatement);
+		if (ReturnCode == SQLITE_ROW)
+		{
+			Page->Rows.AppendRow(*mStatement);
+			mStepRow++;
+		}
+		else
+		{
+			mStatementDone = true;
+			if (ReturnCode == SQLITE_DONE)
+			{
+				SetRowCount(mStepRow);
+			}
+			else
+			{
+				SetError(sqlite3_errmsg(sqlite3_db_handle(mStatement)));
+				Succeeded = false;
+			}
+			break;
+		}
+	}
+
+	if (mStepRow > mKnownRows)
+	{
+		mKnownRows = mStepRow;
+	}
+
+	if (Page->Rows.GetRows() > 0)
+	{
+		PublishPage(std::move(Page));
+	}
+	return Succeeded;
+}
+
+void ResultCursor::FetchRequestedPage(int64_t PageIndex)
+{
+	{
+		std::lock_guard<std::mutex> Lock(mMutex);
+		// going back means a replay from row 0, and a page this far off would be evicted as soon
+		// as it was published; requests left behind while dragging the scrollbar end here
+		if (llabs(PageIndex - mLastRequestedPage) > static_cast<int64_t>(MaxResidentPages / 2))
+		{
+			mRequestedPages.erase(std::remove(mRequestedPages.begin(), mRequestedPages.end(), PageIndex), mRequestedPages.end());
+			return;
+		}
+	}
+	FetchPage(PageIndex);
+}
+
+bool ResultCursor::StepTo(int64_t Row)
+{
+	if (Row < mStepRow || mStatementDone)
+	{
+		// statements can't step backwards, so rewind and skip; anything that writes must not run twice
+		if (!mReadOnly || (mStatementDone && mRowCountKnown && Row >= mKnownRows))
+		{
+			return false;
+		}
+		sqlite3_reset(mStatement);
+		mStepRow = 0;
+		mStatementDone = false;
+	}
+
+	while (mStepRow < Row)
+	{
+		const int ReturnCode = sqlite3_step(mStatement);
+		if (ReturnCode != SQLITE_ROW)
+		{
+			mStatementDone = true;
+			if (ReturnCode == SQLITE_DONE)
+			{
+				SetRowCount(mStepRow);
+			}
+			else
+			{
+				SetError(sqlite3_errmsg(sqlite3_db_handle(mStatement)));
+			}
+			return false;
+		}
+		mStepRow++;
+	}
+	return true;
+}
+
+bool ResultCursor::CountRows(int64_t MaxSteps)
+{
+	if (mRowCountKnown || !mReadOnly || !mStatement)
+	{
+		return false;
+	}
+
+	// a second copy of the statement walks to the end without materialising anything
+	if (!mCountStatement && (!mStatements->Acquire(sqlite3_sql(mStatement), mCountStatement) || !mCountStatement))
+	{
+		return false;
+	}
+
+	for (int64_t Step = 0; Step < MaxSteps; ++Step)
+	{
+		const int ReturnCode = sqlite3_step(mCountStatement);
+		if (ReturnCode == SQLITE_ROW)
+		{
+			mCountedRows++;
+			continue;
+		}
+
+		if (ReturnCode == SQLITE_DONE)
+		{
+			SetRowCount(mCountedRows);
+		}
+		ReleaseCountStatement();
+		return false;
+	}
+
+	if (mCountedRows > mKnownRows)
+	{
+		mKnownRows = mCountedRows;
+	}
+	return true;
+}
+
+void ResultCursor::Close()
+{
+	StatementCache* Statements = nullptr;
+	{
+		std::lock_guard<std::mutex> Lock(mMutex);
+		mExecutor = nullptr;
+		mRequestedPages.clear();
+		std::swap(Statements, mStatements);
+	}
+
+	if (Statements)
+	{
+		Statements->Release(mCountStatement);
+		Statements->Release(mStatement);
+	}
+	mCountStatement = nullptr;
+	mStatement = nullptr;
+}
+
+void ResultCursor::Park()
+{
+	// rows already fetched stay resident; the next fetch replays the statement up to its page
+	if (mStatement && mReadOnly && sqlite3_stmt_busy(mStatement))
+	{
+		sqlite3_reset(mStatement);
+		mStepRow = 0;
+		mStatementDone = false;
+	}
+
+	// the count starts over the next time the worker is idle
+	if (mCountStatement)
+	{
+		ReleaseCountStatement();
+		mCountedRows = 0;
+	}
+}
+
+void ResultCursor::ReleaseCountStatement()
+{
+	if (mCountStatement)
+	{
+		mStatements->Release(mCountStatement);
+		mCountStatement = nullptr;
+	}
+}
+
+void ResultCursor::PublishPage(ResultPagePtr Page)
+{
+	std::lock_guard<std::mutex> Lock(mMutex);
+	const int64_t PageIndex = Page->FirstRow / PageSize;
+	mResidentPages[PageIndex] = std::move(Page);
+
+	// anything that writes can't be replayed, so its rows all stay resident
+	while (mReadOnly && mResidentPages.size() > MaxResidentPages)
+	{
+		auto Farthest = mResidentPages.begin();
+		for (auto It = mResidentPages.begin(); It != mResidentPages.end(); ++It)
+		{
+			if (llabs(It->first - mLastRequestedPage) > llabs(Farthest->first - mLastRequestedPage))
+			{
+				Farthest = It;
+			}
+		}
+		mResidentPages.erase(Farthest);
+	}
+}
+
+void ResultCursor::SetError(const char* Message)
+{
+	std::lock_guard<std::mutex> Lock(mMutex);
+	mErrorMessage = Message ? Message : "Unknown error";
+}
+
+void ResultCursor::SetRowCount(int64_t Rows)
+{
+	mKnownRows = Rows;
+	mRowCountKnown = true;
+	ReleaseCountStatement();
+}
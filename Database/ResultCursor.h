@@ -0,0 +1,101 @@
+#pragma once
+
+#include "ResultSet.h"
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+struct sqlite3_stmt;
+class QueryExecutor;
+class StatementCache;
+
+// A block of consecutive result rows. Pages are immutable once published so the UI can keep
+// drawing one after the cursor has evicted it.
+struct ResultPage
+{
+	explicit ResultPage(int64_t InFirstRow, int NumColumns) : FirstRow(InFirstRow), Rows(NumColumns) {}
+
+	bool Contains(int64_t Row) const { return Row >= FirstRow && Row < FirstRow + static_cast<int64_t>(Rows.GetRows()); }
+
+	const int64_t FirstRow;
+	ResultSet Rows;
+};
+
+using ResultPagePtr = std::shared_ptr<const ResultPage>;
+
+// Streams a statement's rows in fixed-size pages, keeping only a bounded window resident.
+// Pages are stepped on the executor's worker thread; the UI only reads published pages and
+// queues requests for missing ones.
+class ResultCursor final : public std::enable_shared_from_this<ResultCursor>
+{
+public:
+
+	static constexpr int PageSize = 256;
+	static constexpr size_t MaxResidentPages = 32;
+
+	// the statement is handed back to Statements when the cursor is done with it
+	ResultCursor(sqlite3_stmt& Statement, QueryExecutor& Executor, StatementCache& Statements);
+	~ResultCursor();
+
+	ResultCursor(const ResultCursor& copy) = delete;
+	ResultCursor(const ResultCursor&& Rhs) = delete;
+	ResultCursor& operator=(const ResultCursor& Rhs) = delete;
+	ResultCursor& operator=(const ResultCursor&& Rhs) = delete;
+
+	int GetColumns() const { return static_cast<int>(mColumnNames.size()); }
+	const char* GetColumnName(int Column) const { return mColumnNames[Column].c_str(); }
+
+	// rows seen so far by either the cursor or the background count; final once IsRowCountKnown
+	int64_t GetKnownRows() const { return mKnownRows.load(); }
+	bool IsRowCountKnown() const { return mRowCountKnown.load(); }
+
+	// returns nullptr and queues a fetch when the page is not resident
+	ResultPagePtr GetPage(int64_t PageIndex);
+	ResultPagePtr GetPageForRow(int64_t Row) { return GetPage(Row / PageSize); }
+
+	std::string GetErrorMessage() const;
+
+private:
+
+	friend class QueryExecutor;
+
+	// worker thread only
+	bool FetchPage(int64_t PageIndex);
+	// fetches a page the UI asked for, unless it has since scrolled out of the resident window
+	void FetchRequestedPage(int64_t PageIndex);
+	bool CountRows(int64_t MaxSteps);
+	// A statement left part way through its rows keeps the connection busy: DROP and other schema
+	// changes fail with SQLITE_LOCKED and VACUUM with "statements in progress". The executor parks
+	// its cursors before a query or exclusive task, which resets their statements.
+	void Park();
+	void Close();
+
+	bool StepTo(int64_t Row);
+	void PublishPage(ResultPagePtr Page);
+	void SetError(const char* Message);
+	void SetRowCount(int64_t Rows);
+	void ReleaseCountStatement();
+
+	std::vector<std::string> mColumnNames;
+	std::atomic<int64_t> mKnownRows;
+	std::atomic<bool> mRowCountKnown;
+
+	mutable std::mutex mMutex;
+	QueryExecutor* mExecutor;
+	StatementCache* mStatements;
+	std::map<int64_t, ResultPagePtr> mResidentPages;
+	std::vector<int64_t> mRequestedPages;
+	int64_t mLastRequestedPage = 0;
+	std::string mErrorMessage;
+
+	sqlite3_stmt* mStatement;
+	sqlite3_stmt* mCountStatement = nullptr;
+	int64_t mStepRow = 0;
+	int64_t mCountedRows = 0;
+	bool mStatementDone = false;
+	bool mReadOnly = true;
+};
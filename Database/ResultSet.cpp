@@ -0,0 +1,213 @@
+#include "ResultSet.h"
+#include "../sqlite/sqlite3.h"
+#include <stdio.h>
+#include <string.h>
+
+namespace
+{
+	void FormatReal(double Value, char* Buffer, size_t BufferSize)
+	{
+		// matches the text SQLite itself produces for REAL values
+		sqlite3_snprintf(static_cast<int>(BufferSize), Buffer, "%!.15g", Value);
+	}
+
+	ResultColumnType ToColumnType(int SQLiteType)
+	{
+		switch (SQLiteType)
+		{
+		case SQLITE_INTEGER:
+			return ResultColumnType::Integer;
+		case SQLITE_FLOAT:
+			return ResultColumnType::Real;
+		case SQLITE_BLOB:
+			return ResultColumnType::Blob;
+		case SQLITE_NULL:
+			return ResultColumnType::Null;
+		default:
+			return ResultColumnType::Text;
+		}
+	}
+}
+
+ResultSet::ResultSet(int NumColumns)
+	: mColumns(NumColumns)
+{
+}
+
+void ResultSet::Reserve(size_t NumRows)
+{
+	for (auto& Target : mColumns)
+	{
+		Target.NullBits.reserve((NumRows + 63) / 64);
+	}
+}
+
+void ResultSet::AppendRow(sqlite3_stmt& Statement)
+{
+	const size_t Row = mNumRows;
+	for (int ColumnIndex = 0; ColumnIndex < GetColumns(); ++ColumnIndex)
+	{
+		auto& Target = mColumns[ColumnIndex];
+		if (Row % 64 == 0)
+		{
+			Target.NullBits.push_back(0);
+		}
+
+		const auto ValueType = ToColumnType(sqlite3_column_type(&Statement, ColumnIndex));
+		if (ValueType == ResultColumnType::Null)
+		{
+			Target.NullBits[Row / 64] |= uint64_t(1) << (Row % 64);
+			AppendPlaceholder(Target);
+			continue;
+		}
+
+		if (Target.Type == ResultColumnType::Null)
+		{
+			// every earlier row was NULL, so re-home their placeholders in the new representation
+			Target.Type = ValueType;
+			for (size_t Previous = 0; Previous < Row; ++Previous)
+			{
+				AppendPlaceholder(Target);
+			}
+		}
+		else if (Target.Type != ValueType && Target.Type != ResultColumnType::Text)
+		{
+			ConvertToText(Target, Row);
+		}
+
+		switch (Target.Type)
+		{
+		case ResultColumnType::Integer:
+			Target.Integers.push_back(sqlite3_column_int64(&Statement, ColumnIndex));
+			break;
+		case ResultColumnType::Real:
+			Target.Reals.push_back(sqlite3_column_double(&Statement, ColumnIndex));
+			break;
+		case ResultColumnType::Blob:
+		{
+			const void* Data = sqlite3_column_blob(&Statement, ColumnIndex);
+			AppendBytes(Target, Data, static_cast<size_t>(sqlite3_column_bytes(&Statement, ColumnIndex)));
+			break;
+		}
+		default:
+		{
+			const auto* Text = sqlite3_column_text(&Statement, ColumnIndex);
+			AppendBytes(Target, Text, static_cast<size_t>(sqlite3_column_bytes(&Statement, ColumnIndex)));
+			break;
+		}
+		}
+	}
+	mNumRows++;
+}
+
+bool ResultSet::IsNull(size_t Row, int Column) const
+{
+	return (mColumns[Column].NullBits[Row / 64] >> (Row % 64)) & 1;
+}
+
+std::string_view ResultSet::GetBytes(size_t Row, int Column) const
+{
+	return mColumns[Column].Bytes.Get(Row);
+}
+
+const char* ResultSet::GetText(size_t Row, int Column) const
+{
+	return mColumns[Column].Bytes.Get(Row).data();
+}
+
+const char* ResultSet::FormatCell(size_t Row, int Column, char* Buffer, size_t BufferSize) const
+{
+	if (IsNull(Row, Column))
+	{
+		return nullptr;
+	}
+
+	switch (GetColumnType(Column))
+	{
+	case ResultColumnType::Integer:
+		snprintf(Buffer, BufferSize, "%lld", static_cast<long long>(GetInteger(Row, Column)));
+		return Buffer;
+	case ResultColumnType::Real:
+		FormatReal(GetReal(Row, Column), Buffer, BufferSize);
+		return Buffer;
+	case ResultColumnType::Blob:
+		snprintf(Buffer, BufferSize, "<BLOB %zu bytes>", GetBytes(Row, Column).size());
+		return Buffer;
+	default:
+		return GetText(Row, Column);
+	}
+}
+
+size_t ResultSet::GetMemoryUsage() const
+{
+	size_t Bytes = sizeof(*this) + mArena.GetStats().BytesReserved;
+	for (const auto& Source : mColumns)
+	{
+		Bytes += sizeof(Source);
+		Bytes += Source.Integers.capacity() * sizeof(int64_t);
+		Bytes += Source.Reals.capacity() * sizeof(double);
+		Bytes += Source.Bytes.GetMemoryUsage();
+		Bytes += Source.NullBits.capacity() * sizeof(uint64_t);
+	}
+	return Bytes;
+}
+
+void ResultSet::AppendBytes(Column& Target, const void* Data, size_t Length)
+{
+	// stored null-terminated, and empty values share a static empty string
+	Target.Bytes.Append(std::string_view(static_cast<const char*>(Data), Length), &mArena);
+}
+
+void ResultSet::AppendPlaceholder(Column& Target)
+{
+	switch (Target.Type)
+	{
+	case ResultColumnType::Integer:
+		Target.Integers.push_back(0);
+		break;
+	case ResultColumnType::Real:
+		Target.Reals.push_back(0.0);
+		break;
+	case ResultColumnType::Text:
+	case ResultColumnType::Blob:
+		AppendBytes(Target, nullptr, 0);
+		break;
+	default:
+		break;
+	}
+}
+
+void ResultSet::ConvertToText(Column& Target, size_t NumRows)
+{
+	Column Converted;
+	Converted.Type = ResultColumnType::Text;
+	Converted.NullBits = std::move(Target.NullBits);
+
+	char Buffer[64];
+	for (size_t Row = 0; Row < NumRows; ++Row)
+	{
+		const bool Null = (Converted.NullBits[Row / 64] >> (Row % 64)) & 1;
+		if (Null)
+		{
+			AppendBytes(Converted, nullptr, 0);
+			continue;
+		}
+
+		switch (Target.Type)
+		{
+		case ResultColumnType::Integer:
+			snprintf(Buffer, sizeof(Buffer), "%lld", static_cast<long long>(Target.Integers[Row]));
+			AppendBytes(Converted, Buffer, strlen(Buffer));
+			break;
+		case ResultColumnType::Real:
+			FormatReal(Target.Reals[Row], Buffer, sizeof(Buffer));
+			AppendBytes(Converted, Buffer, strlen(Buffer));
+			break;
+		default:
+			// already in the arena, so the view carries over
+			Converted.Bytes.Append(Target.Bytes.Get(Row), nullptr);
+			break;
+		}
+	}
+	Target = std::move(Converted);
+}
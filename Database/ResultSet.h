@@ -0,0 +1,73 @@
+#pragma once
+
+#include "../Serialisation/Arena.h"
+#include "../Serialisation/TextColumn.h"
+#include <string_view>
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+struct sqlite3_stmt;
+
+enum class ResultColumnType : uint8_t
+{
+	Null = 0,
+	Integer,
+	Real,
+	Text,
+	Blob,
+};
+
+// Typed, column-major storage for query results. Each column keeps exactly one physical
+// representation: a column that sees more than one storage class is converted to text the
+// way sqlite3_column_text would have rendered it. Text and blob bytes go into one arena per
+// result set, which is released in whole chunks when the result set is dropped, and text
+// columns with few distinct values are dictionary-encoded, decoded only when a cell is read.
+class ResultSet final
+{
+public:
+
+	explicit ResultSet(int NumColumns = 0);
+
+	void AppendRow(sqlite3_stmt& Statement);
+	void Reserve(size_t NumRows);
+
+	size_t GetRows() const { return mNumRows; }
+	int GetColumns() const { return static_cast<int>(mColumns.size()); }
+	ResultColumnType GetColumnType(int Column) const { return mColumns[Column].Type; }
+
+	bool IsNull(size_t Row, int Column) const;
+	int64_t GetInteger(size_t Row, int Column) const { return mColumns[Column].Integers[Row]; }
+	double GetReal(size_t Row, int Column) const { return mColumns[Column].Reals[Row]; }
+	std::string_view GetBytes(size_t Row, int Column) const;
+	// text and blob cells are stored null-terminated, so this is valid for both
+	const char* GetText(size_t Row, int Column) const;
+	// the codes behind a text or blob column, for comparing cells without decoding them
+	const TextColumn& GetTextColumn(int Column) const { return mColumns[Column].Bytes; }
+
+	// returns nullptr for NULL cells; numbers are formatted into Buffer only when asked for
+	const char* FormatCell(size_t Row, int Column, char* Buffer, size_t BufferSize) const;
+
+	size_t GetMemoryUsage() const;
+	const Arena::Stats& GetArenaStats() const { return mArena.GetStats(); }
+
+private:
+
+	struct Column
+	{
+		ResultColumnType Type = ResultColumnType::Null;
+		std::vector<int64_t> Integers;
+		std::vector<double> Reals;
+		TextColumn Bytes;
+		std::vector<uint64_t> NullBits;
+	};
+
+	void AppendBytes(Column& Target, const void* Data, size_t Length);
+	void AppendPlaceholder(Column& Target);
+	void ConvertToText(Column& Target, size_t NumRows);
+
+	std::vector<Column> mColumns;
+	size_t mNumRows = 0;
+	// text converted from another type leaves its old bytes here until the result set goes
+	Arena mArena;
+};
@@ -0,0 +1,51 @@
+#include "RowidIndex.h"
+
+void RowidIndex::Append(int64_t Rowid)
+{
+	mOpen.push_back(Rowid);
+	mRows++;
+	if (static_cast<int64_t>(mOpen.size()) == BlockRows)
+	{
+		CloseBlock();
+	}
+}
+
+size_t RowidIndex::GetMemoryUsage() const
+{
+	return mBlocks.capacity() * sizeof(Block) + (mScattered.capacity() + mOpen.capacity()) * sizeof(int64_t);
+}
+
+bool RowidIndex::Find(int64_t Row, int64_t& OutRowid) const
+{
+	if (Row < 0 || Row >= mRows)
+	{
+		return false;
+	}
+
+	const size_t BlockIndex = static_cast<size_t>(Row / BlockRows);
+	const int64_t Offset = Row % BlockRows;
+	if (BlockIndex == mBlocks.size())
+	{
+		OutRowid = mOpen[Offset];
+		return true;
+	}
+
+	const Block& Found = mBlocks[BlockIndex];
+	OutRowid = Found.FirstScattered < 0 ? Found.FirstRowid + Offset : mScattered[Found.FirstScattered + Offset];
+	return true;
+}
+
+void RowidIndex::CloseBlock()
+{
+	// ascending and unique, so a block spanning exactly BlockRows rowids has no gaps
+	if (mOpen.back() - mOpen.front() == BlockRows - 1)
+	{
+		mBlocks.push_back({ mOpen.front(), -1 });
+	}
+	else
+	{
+		mBlocks.push_back({ mOpen.front(), static_cast<int64_t>(mScattered.size()) });
+		mScattered.insert(mScattered.end(), mOpen.begin(), mOpen.end());
+	}
+	mOpen.clear();
+}
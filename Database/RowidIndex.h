@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+// Maps row positions to rowids in blocks of BlockRows rows. A block of consecutive rowids keeps
+// only its first one; any other block keeps all of its rowids in a plain array. A lookup is a
+// division and an array read rather than an OFFSET scan, and a table full of gaps costs little
+// more than a vector of its rowids.
+class RowidIndex final
+{
+public:
+
+	static constexpr int64_t BlockRows = 64;
+
+	// rowids must be appended in ascending order
+	void Append(int64_t Rowid);
+
+	int64_t GetRows() const { return mRows; }
+	size_t GetMemoryUsage() const;
+
+	// false when Row is past the end of what has been indexed so far
+	bool Find(int64_t Row, int64_t& OutRowid) const;
+
+private:
+
+	struct Block
+	{
+		int64_t FirstRowid;
+		// where the block's rowids start in mScattered, or -1 when they are consecutive
+		int64_t FirstScattered;
+	};
+
+	void CloseBlock();
+
+	std::vector<Block> mBlocks;
+	std::vector<int64_t> mScattered;
+	// the block being filled, until it holds BlockRows rowids
+	std::vector<int64_t> mOpen;
+	int64_t mRows = 0;
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <utility>
+#include <vector>
+#include <stddef.h>
+
+// Bounded single-producer, single-consumer queue. Neither side takes a lock: the producer only
+// writes mTail and the consumer only writes mHead, each published with release ordering, so
+// the slot a side reads is always fully written by the other. The indices sit on separate
+// cache lines so the two threads don't keep invalidating each other's line.
+template <typename T>
+class SPSCRing final
+{
+public:
+
+	// Capacity is rounded up to a power of two
+	explicit SPSCRing(size_t Capacity)
+	{
+		size_t Slots = 1;
+		while (Slots < Capacity)
+		{
+			Slots <<= 1;
+		}
+		mSlots.resize(Slots);
+		mMask = Slots - 1;
+	}
+
+	SPSCRing(const SPSCRing& copy) = delete;
+	SPSCRing(const SPSCRing&& Rhs) = delete;
+	SPSCRing& operator=(const SPSCRing& Rhs) = delete;
+	SPSCRing& operator=(const SPSCRing&& Rhs) = delete;
+
+	// producer only; Value is left untouched when the ring is full
+	bool TryPush(T& Value)
+	{
+		const size_t Tail = mTail.load(std::memory_order_relaxed);
+		if (Tail - mHead.load(std::memory_order_acquire) == mSlots.size())
+		{
+			return false;
+		}
+		mSlots[Tail & mMask] = std::move(Value);
+		mTail.store(Tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	// consumer only; the front stays valid until Pop
+	T* Front()
+	{
+		const size_t Head = mHead.load(std::memory_order_relaxed);
+		return Head == mTail.load(std::memory_order_acquire) ? nullptr : &mSlots[Head & mMask];
+	}
+
+	void Pop()
+	{
+		const size_t Head = mHead.load(std::memory_order_relaxed);
+		mSlots[Head & mMask] = T();
+		mHead.store(Head + 1, std::memory_order_release);
+	}
+
+	// either side; only a snapshot while the other side is running
+	size_t GetSize() const { return mTail.load(std::memory_order_acquire) - mHead.load(std::memory_order_acquire); }
+	size_t GetCapacity() const { return mSlots.size(); }
+
+private:
+
+	std::vector<T> mSlots;
+	size_t mMask = 0;
+	alignas(64) std::atomic<size_t> mHead{ 0 };
+	alignas(64) std::atomic<size_t> mTail{ 0 };
+};
@@ -0,0 +1,292 @@
+#include "StatementCache.h"
+#include "../sqlite/sqlite3.h"
+#include <ctype.h>
+
+StatementCache::StatementCache(sqlite3& Connection, size_t Capacity)
+	: mConnection(Connection)
+	, mCapacity(Capacity)
+	, mHits(0)
+	, mMisses(0)
+{
+}
+
+StatementCache::~StatementCache()
+{
+	Clear();
+}
+
+bool StatementCache::Acquire(std::string_view Sql, sqlite3_stmt*& Statement)
+{
+	Statement = nullptr;
+	std::string Key = Normalize(Sql);
+	if (TakeCached(Key, Statement))
+	{
+		return true;
+	}
+
+	mMisses++;
+	if (sqlite3_prepare_v2(&mConnection, Sql.data(), static_cast<int>(Sql.size()), &Statement, nullptr) != SQLITE_OK)
+	{
+		sqlite3_finalize(Statement);
+		Statement = nullptr;
+		return false;
+	}
+
+	if (Statement)
+	{
+		std::lock_guard<std::mutex> Lock(mMutex);
+		mCheckedOut.emplace(Statement, std::move(Key));
+	}
+	return true;
+}
+
+bool StatementCache::AcquireNext(const char* Script, sqlite3_stmt*& Statement, const char*& Tail)
+{
+	// A cached statement was prepared from text with the same key, which SQLite ended in the same
+	// place, so a hit can take the splitter's end as its tail.
+	Statement = nullptr;
+	const char* End = FindStatementEnd(Script);
+	std::string Key = Normalize(std::string_view(Script, End - Script));
+	if (!Key.empty() && TakeCached(Key, Statement))
+	{
+		Tail = End;
+		return true;
+	}
+
+	mMisses++;
+	Tail = End;
+	if (sqlite3_prepare_v2(&mConnection, Script, -1, &Statement, &Tail) != SQLITE_OK)
+	{
+		sqlite3_finalize(Statement);
+		Statement = nullptr;
+		return false;
+	}
+
+	if (Statement)
+	{
+		if (Tail != End)
+		{
+			Key = Normalize(std::string_view(Script, Tail - Script));
+		}
+		std::lock_guard<std::mutex> Lock(mMutex);
+		mCheckedOut.emplace(Statement, std::move(Key));
+	}
+	return true;
+}
+
+bool StatementCache::TakeCached(std::string& Key, sqlite3_stmt*& Statement)
+{
+	std::lock_guard<std::mutex> Lock(mMutex);
+	const auto Cached = mIndex.find(Key);
+	if (Cached == mIndex.end())
+	{
+		return false;
+	}
+
+	Statement = Cached->second->second;
+	mRecentlyUsed.erase(Cached->second);
+	mIndex.erase(Cached);
+	mCheckedOut.emplace(Statement, std::move(Key));
+	mHits++;
+	return true;
+}
+
+void StatementCache::Release(sqlite3_stmt* Statement)
+{
+	if (!Statement)
+	{
+		return;
+	}
+
+	sqlite3_reset(Statement);
+	sqlite3_clear_bindings(Statement);
+
+	sqlite3_stmt* Evicted = nullptr;
+	{
+		std::lock_guard<std::mutex> Lock(mMutex);
+		const auto CheckedOut = mCheckedOut.find(Statement);
+		if (CheckedOut == mCheckedOut.end() || mIndex.count(CheckedOut->second))
+		{
+			// not ours, or a second copy of something already cached
+			if (CheckedOut != mCheckedOut.end())
+			{
+				mCheckedOut.erase(CheckedOut);
+			}
+			Evicted = Statement;
+		}
+		else
+		{
+			mRecentlyUsed.emplace_front(std::move(CheckedOut->second), Statement);
+			mIndex.emplace(mRecentlyUsed.front().first, mRecentlyUsed.begin());
+			mCheckedOut.erase(CheckedOut);
+
+			if (mRecentlyUsed.size() > mCapacity)
+			{
+				Evicted = mRecentlyUsed.back().second;
+				mIndex.erase(mRecentlyUsed.back().first);
+				mRecentlyUsed.pop_back();
+			}
+		}
+	}
+	sqlite3_finalize(Evicted);
+}
+
+void StatementCache::Clear()
+{
+	std::lock_guard<std::mutex> Lock(mMutex);
+	for (auto& Cached : mRecentlyUsed)
+	{
+		sqlite3_finalize(Cached.second);
+	}
+	mRecentlyUsed.clear();
+	mIndex.clear();
+}
+
+const char* StatementCache::FindStatementEnd(const char* Sql)
+{
+	// split on semicolons outside quotes and comments. Only a trigger body can hold a semicolon
+	// that doesn't end the statement, so once a TRIGGER keyword is seen SQLite confirms each one;
+	// the text it checks is built up as the scan goes rather than copied again every time
+	bool MaybeTrigger = false;
+	std::string Prefix;
+	const char* Copied = Sql;
+	const char* Cursor = Sql;
+	while (*Cursor)
+	{
+		const char Character = *Cursor;
+		if (isalpha(static_cast<unsigned char>(Character)) || Character == '_')
+		{
+			const char* Word = Cursor;
+			while (isalnum(static_cast<unsigned char>(*Cursor)) || *Cursor == '_')
+			{
+				Cursor++;
+			}
+			if (Cursor - Word == 7 && sqlite3_strnicmp(Word, "TRIGGER", 7) == 0)
+			{
+				MaybeTrigger = true;
+			}
+			continue;
+		}
+		else if (Character == '\'' || Character == '"' || Character == '`' || Character == '[')
+		{
+			const char Close = Character == '[' ? ']' : Character;
+			Cursor++;
+			while (*Cursor && *Cursor != Close)
+			{
+				Cursor++;
+			}
+		}
+		else if (Character == '-' && Cursor[1] == '-')
+		{
+			while (*Cursor && *Cursor != '\n')
+			{
+				Cursor++;
+			}
+			continue;
+		}
+		else if (Character == '/' && Cursor[1] == '*')
+		{
+			Cursor += 2;
+			while (*Cursor && !(Cursor[0] == '*' && Cursor[1] == '/'))
+			{
+				Cursor++;
+			}
+			if (*Cursor)
+			{
+				Cursor++;
+			}
+		}
+		else if (Character == ';')
+		{
+			if (!MaybeTrigger)
+			{
+				return Cursor + 1;
+			}
+			Prefix.append(Copied, Cursor + 1);
+			Copied = Cursor + 1;
+			if (sqlite3_complete(Prefix.c_str()))
+			{
+				return Cursor + 1;
+			}
+		}
+
+		if (*Cursor)
+		{
+			Cursor++;
+		}
+	}
+	return Cursor;
+}
+
+std::string StatementCache::Normalize(std::string_view Sql)
+{
+	std::string Normalized;
+	Normalized.reserve(Sql.size());
+
+	// Literals and comments are copied as they are. A line comment ends at its newline, so that
+	// is kept as the closing "quote"; a block comment has its own state, as it ends on two
+	// characters. Either way a quote inside a comment never starts a literal.
+	char Quote = 0;
+	bool InBlockComment = false;
+	// where the block comment's text starts, so the '*' that opened it can't also close it
+	size_t CommentText = 0;
+	bool PendingSpace = false;
+	for (const char Character : Sql)
+	{
+		if (InBlockComment)
+		{
+			Normalized.push_back(Character);
+			if (Character == '/' && Normalized.size() - 2 >= CommentText && Normalized[Normalized.size() - 2] == '*')
+			{
+				InBlockComment = false;
+			}
+			continue;
+		}
+		if (Quote)
+		{
+			Normalized.push_back(Character);
+			if (Character == Quote)
+			{
+				Quote = 0;
+			}
+			continue;
+		}
+
+		if (Character == '-' && !Normalized.empty() && Normalized.back() == '-' && !PendingSpace)
+		{
+			Quote = '\n';
+		}
+		else if (Character == '*' && !Normalized.empty() && Normalized.back() == '/' && !PendingSpace)
+		{
+			InBlockComment = true;
+			CommentText = Normalized.size() + 1;
+		}
+
+		if (isspace(static_cast<unsigned char>(Character)))
+		{
+			PendingSpace = !Normalized.empty();
+			continue;
+		}
+
+		if (PendingSpace)
+		{
+			Normalized.push_back(' ');
+			PendingSpace = false;
+		}
+		if (Character == '\'' || Character == '"' || Character == '`')
+		{
+			Quote = Character;
+		}
+		else if (Character == '[')
+		{
+			Quote = ']';
+		}
+		Normalized.push_back(Character);
+	}
+
+	while (!Normalized.empty() && (Normalized.back() == ';' || Normalized.back() == ' '))
+	{
+		Normalized.pop_back();
+	}
+	return Normalized;
+}
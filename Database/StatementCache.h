@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <stdint.h>
+
+struct sqlite3;
+struct sqlite3_stmt;
+
+// LRU cache of prepared statements for one connection, keyed on whitespace-normalised SQL;
+// string literals and comments are left as they are.
+// Acquire hands out exclusive use of a statement; Release resets it and puts it back.
+class StatementCache final
+{
+public:
+
+	static constexpr size_t DefaultCapacity = 64;
+
+	explicit StatementCache(sqlite3& Connection, size_t Capacity = DefaultCapacity);
+	~StatementCache();
+
+	StatementCache(const StatementCache& copy) = delete;
+	StatementCache(const StatementCache&& Rhs) = delete;
+	StatementCache& operator=(const StatementCache& Rhs) = delete;
+	StatementCache& operator=(const StatementCache&& Rhs) = delete;
+
+	// Sql must hold a single statement. Returns false on a prepare error (see sqlite3_errmsg);
+	// Statement is left null when the text is only whitespace or comments.
+	bool Acquire(std::string_view Sql, sqlite3_stmt*& Statement);
+	// Acquires the first statement of a script. Tail is set to where sqlite3_prepare_v2 says the
+	// next statement starts, so SQLite rather than FindStatementEnd decides where each ends.
+	bool AcquireNext(const char* Script, sqlite3_stmt*& Statement, const char*& Tail);
+	void Release(sqlite3_stmt* Statement);
+
+	// finalizes every cached statement; call before closing the connection
+	void Clear();
+
+	sqlite3& GetConnection() const { return mConnection; }
+	uint64_t GetHits() const { return mHits.load(); }
+	uint64_t GetMisses() const { return mMisses.load(); }
+
+	// Returns the end of the first complete statement in Sql, or the end of the text. Only used
+	// to find a script's next statement in the cache; prepares take SQLite's tail.
+	static const char* FindStatementEnd(const char* Sql);
+	static std::string Normalize(std::string_view Sql);
+
+private:
+
+	// looks Key up, handing out the cached statement on a hit
+	bool TakeCached(std::string& Key, sqlite3_stmt*& Statement);
+
+	using Entry = std::pair<std::string, sqlite3_stmt*>;
+
+	sqlite3& mConnection;
+	const size_t mCapacity;
+
+	std::mutex mMutex;
+	std::list<Entry> mRecentlyUsed;
+	std::unordered_map<std::string, std::list<Entry>::iterator> mIndex;
+	std::unordered_map<sqlite3_stmt*, std::string> mCheckedOut;
+
+	std::atomic<uint64_t> mHits;
+	std::atomic<uint64_t> mMisses;
+};
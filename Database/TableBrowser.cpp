@@ -0,0 +1,523 @@
+#include "TableBrowser.h"
+#include "QueryExecutor.h"
+#include "StatementCache.h"
+#include "../sqlite/sqlite3.h"
+#include <algorithm>
+#include <stdlib.h>
+
+namespace
+{
+	// pages of keys the background index walks per call before yielding to other work
+	constexpr int64_t IndexChunkPages = 64;
+
+	std::string QuoteIdentifier(const std::string& Name)
+	{
+		std::string Quoted = "\"";
+		for (const char Character : Name)
+		{
+			Quoted += Character;
+			if (Character == '"')
+			{
+				Quoted += '"';
+			}
+		}
+		Quoted += '"';
+		return Quoted;
+	}
+
+	bool HasColumn(const std::vector<std::string>& Columns, const char* Name)
+	{
+		return std::any_of(Columns.begin(), Columns.end(), [Name](const std::string& Column) { return sqlite3_stricmp(Column.c_str(), Name) == 0; });
+	}
+}
+
+std::shared_ptr<TableBrowser> TableBrowser::Open(QueryExecutor& Executor, const std::string& TableName)
+{
+	auto Browser = std::make_shared<TableBrowser>(Executor, TableName);
+	std::weak_ptr<TableBrowser> Weak = Browser;
+
+	Executor.Post([Weak](StatementCache& Statements)
+	{
+		if (auto Live = Weak.lock())
+		{
+			Live->Describe(Statements);
+			Live->FetchPage(Statements, 0);
+		}
+	});
+
+	Executor.PostBackground([Weak](StatementCache& Statements)
+	{
+		auto Live = Weak.lock();
+		if (!Live || !Live->IsReady())
+		{
+			return false;
+		}
+		return Live->mNumKeys > 0 ? Live->ExtendPageIndex(Statements) : Live->CountRows(Statements);
+	});
+	return Browser;
+}
+
+TableBrowser::TableBrowser(QueryExecutor& Executor, const std::string& TableName)
+	: mExecutor(Executor)
+	, mTableName(TableName)
+	, mReady(false)
+	, mKnownRows(0)
+	, mRowCountKnown(false)
+	, mRowidIndexBytes(0)
+{
+}
+
+ResultPagePtr TableBrowser::GetPage(int64_t PageIndex)
+{
+	std::lock_guard<std::mutex> Lock(mMutex);
+	mLastRequestedPage = PageIndex;
+
+	RequestPage(PageIndex);
+	RequestPage(PageIndex + 1);
+	RequestPage(PageIndex - 1);
+
+	const auto Resident = mResidentPages.find(PageIndex);
+	return Resident != mResidentPages.end() ? Resident->second : nullptr;
+}
+
+ResultPagePtr TableBrowser::GetRecord(int64_t Row)
+{
+	if (!mReady || !mRowidKeyed)
+	{
+		return GetPageForRow(Row);
+	}
+
+	std::lock_guard<std::mutex> Lock(mMutex);
+	mLastRequestedRecord = Row;
+
+	// one task fetches whatever part of the ring is missing, the requested row first
+	std::vector<int64_t> Missing;
+	for (int64_t Distance = 0; Distance <= RecordRing; ++Distance)
+	{
+		for (const int64_t Neighbour : { Row + Distance, Row - Distance })
+		{
+			const bool Known = mRecords.count(Neighbour) || std::find(mRequestedRecords.begin(), mRequestedRecords.end(), Neighbour) != mRequestedRecords.end();
+			const bool PastEnd = mRowCountKnown && Neighbour >= mKnownRows;
+			if (Neighbour >= 0 && !PastEnd && !Known && mErrorMessage.empty())
+			{
+				Missing.push_back(Neighbour);
+				mRequestedRecords.push_back(Neighbour);
+			}
+			if (Distance == 0)
+			{
+				break;
+			}
+		}
+	}
+
+	if (!Missing.empty())
+	{
+		std::weak_ptr<TableBrowser> Weak = shared_from_this();
+		mExecutor.Post([Weak, Missing](StatementCache& Statements)
+		{
+			if (auto Live = Weak.lock())
+			{
+				Live->FetchRecords(Statements, Missing);
+			}
+		});
+	}
+
+	const auto Resident = mRecords.find(Row);
+	return Resident != mRecords.end() ? Resident->second : nullptr;
+}
+
+std::string TableBrowser::GetErrorMessage() const
+{
+	std::lock_guard<std::mutex> Lock(mMutex);
+	return mErrorMessage;
+}
+
+void TableBrowser::RequestPage(int64_t PageIndex)
+{
+	if (PageIndex < 0 || mResidentPages.count(PageIndex) || !mErrorMessage.empty())
+	{
+		return;
+	}
+	if (mRowCountKnown && PageIndex * PageSize >= mKnownRows)
+	{
+		return;
+	}
+	if (std::find(mRequestedPages.begin(), mRequestedPages.end(), PageIndex) != mRequestedPages.end())
+	{
+		return;
+	}
+
+	mRequestedPages.push_back(PageIndex);
+	std::weak_ptr<TableBrowser> Weak = shared_from_this();
+	mExecutor.Post([Weak, PageIndex](StatementCache& Statements)
+	{
+		if (auto Live = Weak.lock())
+		{
+			Live->FetchPage(Statements, PageIndex);
+		}
+	});
+}
+
+void TableBrowser::Describe(StatementCache& Statements)
+{
+	sqlite3& Connection = Statements.GetConnection();
+	const std::string Table = QuoteIdentifier(mTableName);
+
+	sqlite3_stmt* Statement = nullptr;
+	if (!Statements.Acquire("SELECT * FROM " + Table, Statement) || !Statement)
+	{
+		SetError(sqlite3_errmsg(&Connection));
+		return;
+	}
+	for (int Column = 0; Column < sqlite3_column_count(Statement); ++Column)
+	{
+		const char* Name = sqlite3_column_name(Statement, Column);
+		mColumnNames.emplace_back(Name ? Name : "");
+	}
+	Statements.Release(Statement);
+
+	// views accept "rowid" too but it is NULL for every row, so only real tables are keyed
+	bool IsTable = false;
+	if (Statements.Acquire("SELECT type = 'table' FROM sqlite_master WHERE name = ?1 COLLATE NOCASE", Statement) && Statement)
+	{
+		sqlite3_bind_text(Statement, 1, mTableName.c_str(), static_cast<int>(mTableName.size()), SQLITE_STATIC);
+		IsTable = sqlite3_step(Statement) == SQLITE_ROW && sqlite3_column_int(Statement, 0) != 0;
+		Statements.Release(Statement);
+	}
+
+	// a rowid alias only works if the table doesn't have a real column by that name
+	for (const char* Alias : { "rowid", "_rowid_", "oid" })
+	{
+		if (!IsTable || HasColumn(mColumnNames, Alias))
+		{
+			continue;
+		}
+		if (Statements.Acquire("SELECT " + std::string(Alias) + " FROM " + Table, Statement) && Statement)
+		{
+			Statements.Release(Statement);
+			mKeyColumns = Alias;
+			mNumKeys = 1;
+			mRowidKeyed = true;
+			mRecordQuery = "SELECT *, " + mKeyColumns + " FROM " + Table + " WHERE " + mKeyColumns + " = ?1";
+		}
+		break;
+	}
+
+	// WITHOUT ROWID tables are ordered by their primary key instead
+	if (IsTable && mNumKeys == 0 && Statements.Acquire("SELECT name FROM pragma_table_info(?1) WHERE pk > 0 ORDER BY pk", Statement) && Statement)
+	{
+		sqlite3_bind_text(Statement, 1, mTableName.c_str(), static_cast<int>(mTableName.size()), SQLITE_STATIC);
+		while (sqlite3_step(Statement) == SQLITE_ROW)
+		{
+			mKeyColumns += mNumKeys++ ? ", " : "";
+			mKeyColumns += QuoteIdentifier(reinterpret_cast<const char*>(sqlite3_column_text(Statement, 0)));
+		}
+		Statements.Release(Statement);
+	}
+
+	if (mNumKeys > 0)
+	{
+		std::string Bounds;
+		for (int Key = 1; Key <= mNumKeys; ++Key)
+		{
+			Bounds += (Key > 1 ? ", ?" : "?") + std::to_string(Key);
+		}
+		const std::string Limit = " LIMIT ?" + std::to_string(mNumKeys + 1);
+		const std::string After = " WHERE (" + mKeyColumns + ") > (" + Bounds + ")";
+		const std::string Order = " ORDER BY " + mKeyColumns;
+
+		mFirstPageQuery = "SELECT *, " + mKeyColumns + " FROM " + Table + Order + " LIMIT ?1";
+		mNextPageQuery = "SELECT *, " + mKeyColumns + " FROM " + Table + After + Order + Limit;
+		mFirstIndexQuery = "SELECT " + mKeyColumns + " FROM " + Table + Order + " LIMIT ?1";
+		mNextIndexQuery = "SELECT " + mKeyColumns + " FROM " + Table + After + Order + Limit;
+	}
+	else
+	{
+		// views and virtual tables without a rowid can only be paged by offset
+		mFirstPageQuery = "SELECT * FROM " + Table + " LIMIT ?1 OFFSET ?2";
+	}
+
+	mReady = true;
+}
+
+void TableBrowser::FetchPage(StatementCache& Statements, int64_t PageIndex)
+{
+	{
+		std::lock_guard<std::mutex> Lock(mMutex);
+		mRequestedPages.erase(std::remove(mRequestedPages.begin(), mRequestedPages.end(), PageIndex), mRequestedPages.end());
+		if (!mReady || mResidentPages.count(PageIndex))
+		{
+			return;
+		}
+		// the view has moved on, and the page would be evicted as soon as it was published
+		if (llabs(PageIndex - mLastRequestedPage) > static_cast<int64_t>(MaxResidentPages / 2))
+		{
+			return;
+		}
+	}
+
+	const bool Keyed = mNumKeys > 0;
+	if (Keyed)
+	{
+		// a jump ahead of the background index walks the keys up to it first
+		while (PageIndex > 0 && GetIndexedPages() < PageIndex && ExtendPageIndex(Statements))
+		{
+		}
+		if (PageIndex > 0 && GetIndexedPages() < PageIndex)
+		{
+			return;
+		}
+	}
+
+	sqlite3_stmt* Statement = nullptr;
+	const std::string& Query = Keyed && PageIndex > 0 ? mNextPageQuery : mFirstPageQuery;
+	if (!Statements.Acquire(Query, Statement) || !Statement)
+	{
+		SetError(sqlite3_errmsg(&Statements.GetConnection()));
+		return;
+	}
+
+	if (Keyed && PageIndex > 0)
+	{
+		BindKey(*Statement, mPageEnds, static_cast<size_t>(PageIndex - 1));
+		sqlite3_bind_int(Statement, mNumKeys + 1, PageSize);
+	}
+	else
+	{
+		sqlite3_bind_int(Statement, 1, PageSize);
+		if (!Keyed)
+		{
+			sqlite3_bind_int64(Statement, 2, PageIndex * PageSize);
+		}
+	}
+
+	auto Page = std::make_shared<ResultPage>(PageIndex * PageSize, GetColumns());
+	Page->Rows.Reserve(PageSize);
+
+	int ReturnCode = sqlite3_step(Statement);
+	while (ReturnCode == SQLITE_ROW)
+	{
+		Page->Rows.AppendRow(*Statement);
+
+		// a full page tells us where the next one starts without waiting for the index
+		if (Keyed && Page->Rows.GetRows() == PageSize && GetIndexedPages() == PageIndex)
+		{
+			AppendKey(mPageEnds, *Statement, GetColumns());
+		}
+		ReturnCode = sqlite3_step(Statement);
+	}
+
+	if (ReturnCode != SQLITE_DONE)
+	{
+		SetError(sqlite3_errmsg(&Statements.GetConnection()));
+	}
+	Statements.Release(Statement);
+
+	const int64_t EndRow = Page->FirstRow + static_cast<int64_t>(Page->Rows.GetRows());
+	if (ReturnCode == SQLITE_DONE && Page->Rows.GetRows() < PageSize)
+	{
+		SetRowCount(EndRow);
+	}
+	else
+	{
+		UpdateKnownRows(EndRow);
+	}
+
+	if (Page->Rows.GetRows() > 0)
+	{
+		PublishPage(std::move(Page));
+	}
+}
+
+bool TableBrowser::ExtendPageIndex(StatementCache& Statements)
+{
+	if (mPageIndexComplete)
+	{
+		return false;
+	}
+
+	sqlite3_stmt* Statement = nullptr;
+	if (!Statements.Acquire(mScannedRows > 0 ? mNextIndexQuery : mFirstIndexQuery, Statement) || !Statement)
+	{
+		SetError(sqlite3_errmsg(&Statements.GetConnection()));
+		mPageIndexComplete = true;
+		return false;
+	}
+
+	const int64_t Limit = IndexChunkPages * PageSize;
+	if (mScannedRows > 0)
+	{
+		BindKey(*Statement, mLastScannedKey, 0);
+		sqlite3_bind_int64(Statement, mNumKeys + 1, Limit);
+	}
+	else
+	{
+		sqlite3_bind_int64(Statement, 1, Limit);
+	}
+
+	// only the key of every PageSize-th row is kept, plus every rowid in the rowid index
+	int64_t Rows = 0;
+	int ReturnCode = sqlite3_step(Statement);
+	while (ReturnCode == SQLITE_ROW)
+	{
+		Rows++;
+		mScannedRows++;
+		if (mRowidKeyed)
+		{
+			mRowids.Append(sqlite3_column_int64(Statement, 0));
+		}
+		if (mScannedRows % PageSize == 0 && GetIndexedPages() == mScannedRows / PageSize - 1)
+		{
+			AppendKey(mPageEnds, *Statement, 0);
+		}
+		if (Rows == Limit)
+		{
+			mLastScannedKey.clear();
+			AppendKey(mLastScannedKey, *Statement, 0);
+		}
+		ReturnCode = sqlite3_step(Statement);
+	}
+	mRowidIndexBytes = mRowids.GetMemoryUsage();
+
+	if (ReturnCode != SQLITE_DONE)
+	{
+		SetError(sqlite3_errmsg(&Statements.GetConnection()));
+		mPageIndexComplete = true;
+	}
+	else if (Rows < Limit)
+	{
+		SetRowCount(mScannedRows);
+		mPageIndexComplete = true;
+	}
+	else
+	{
+		UpdateKnownRows(mScannedRows);
+	}
+	Statements.Release(Statement);
+	return !mPageIndexComplete;
+}
+
+void TableBrowser::FetchRecords(StatementCache& Statements, const std::vector<int64_t>& Rows)
+{
+	sqlite3_stmt* Statement = nullptr;
+	if (!Statements.Acquire(mRecordQuery, Statement) || !Statement)
+	{
+		SetError(sqlite3_errmsg(&Statements.GetConnection()));
+		return;
+	}
+
+	for (const int64_t Row : Rows)
+	{
+		// a jump past the background scan walks the rowids up to it first
+		while (mRowids.GetRows() <= Row && ExtendPageIndex(Statements))
+		{
+		}
+
+		auto Record = std::make_shared<ResultPage>(Row, GetColumns());
+		int64_t Rowid = 0;
+		if (mRowids.Find(Row, Rowid))
+		{
+			sqlite3_bind_int64(Statement, 1, Rowid);
+			if (sqlite3_step(Statement) == SQLITE_ROW)
+			{
+				Record->Rows.AppendRow(*Statement);
+			}
+			sqlite3_reset(Statement);
+		}
+
+		std::lock_guard<std::mutex> Lock(mMutex);
+		mRequestedRecords.erase(std::remove(mRequestedRecords.begin(), mRequestedRecords.end(), Row), mRequestedRecords.end());
+		// a row that is gone, or that the index hasn't reached, is kept as an empty page so the
+		// UI doesn't ask for it again every frame
+		mRecords[Row] = std::move(Record);
+
+		for (auto It = mRecords.begin(); It != mRecords.end();)
+		{
+			It = llabs(It->first - mLastRequestedRecord) > RecordRing * 2 ? mRecords.erase(It) : std::next(It);
+		}
+	}
+	Statements.Release(Statement);
+}
+
+bool TableBrowser::CountRows(StatementCache& Statements)
+{
+	sqlite3_stmt* Statement = nullptr;
+	if (!Statements.Acquire("SELECT count(*) FROM " + QuoteIdentifier(mTableName), Statement) || !Statement)
+	{
+		SetError(sqlite3_errmsg(&Statements.GetConnection()));
+		return false;
+	}
+
+	if (sqlite3_step(Statement) == SQLITE_ROW)
+	{
+		SetRowCount(sqlite3_column_int64(Statement, 0));
+	}
+	else
+	{
+		SetError(sqlite3_errmsg(&Statements.GetConnection()));
+	}
+	Statements.Release(Statement);
+	return false;
+}
+
+void TableBrowser::AppendKey(std::vector<KeyValue>& Keys, sqlite3_stmt& Statement, int FirstColumn) const
+{
+	// copies, as column values only live until the statement steps again
+	for (int Key = 0; Key < mNumKeys; ++Key)
+	{
+		Keys.emplace_back(sqlite3_value_dup(sqlite3_column_value(&Statement, FirstColumn + Key)));
+	}
+}
+
+void TableBrowser::BindKey(sqlite3_stmt& Statement, const std::vector<KeyValue>& Keys, size_t Row) const
+{
+	for (int Key = 0; Key < mNumKeys; ++Key)
+	{
+		sqlite3_bind_value(&Statement, Key + 1, Keys[Row * mNumKeys + Key].get());
+	}
+}
+
+void TableBrowser::ValueDeleter::operator()(sqlite3_value* Value) const
+{
+	sqlite3_value_free(Value);
+}
+
+void TableBrowser::PublishPage(ResultPagePtr Page)
+{
+	std::lock_guard<std::mutex> Lock(mMutex);
+	const int64_t PageIndex = Page->FirstRow / PageSize;
+	mResidentPages[PageIndex] = std::move(Page);
+
+	while (mResidentPages.size() > MaxResidentPages)
+	{
+		auto Farthest = mResidentPages.begin();
+		for (auto It = mResidentPages.begin(); It != mResidentPages.end(); ++It)
+		{
+			if (llabs(It->first - mLastRequestedPage) > llabs(Farthest->first - mLastRequestedPage))
+			{
+				Farthest = It;
+			}
+		}
+		mResidentPages.erase(Farthest);
+	}
+}
+
+void TableBrowser::SetError(const char* Message)
+{
+	std::lock_guard<std::mutex> Lock(mMutex);
+	mErrorMessage = Message ? Message : "Unknown error";
+}
+
+void TableBrowser::SetRowCount(int64_t Rows)
+{
+	mKnownRows = Rows;
+	mRowCountKnown = true;
+}
+
+void TableBrowser::UpdateKnownRows(int64_t Rows)
+{
+	if (!mRowCountKnown && Rows > mKnownRows)
+	{
+		mKnownRows = Rows;
+	}
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include "ResultCursor.h"
+#include "ResultSet.h"
+#include "RowidIndex.h"
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+struct sqlite3_stmt;
+struct sqlite3_value;
+class QueryExecutor;
+class StatementCache;
+
+// Pages through one table by key range instead of materialising it. Each page is read with
+// "WHERE key > <last key of the previous page> ORDER BY key LIMIT n", where the key is the
+// rowid, or the primary key of a WITHOUT ROWID table, so any page costs one index seek.
+// The last key of every page is collected in the background so the grid can jump anywhere.
+// Everything that touches SQLite runs on the executor's worker; the browser must not outlive it.
+class TableBrowser final : public std::enable_shared_from_this<TableBrowser>
+{
+public:
+
+	static constexpr int PageSize = 256;
+	static constexpr size_t MaxResidentPages = 32;
+	// records fetched either side of the one being viewed
+	static constexpr int64_t RecordRing = 4;
+
+	// returns immediately; the schema lookup, first page and page index run on the executor
+	static std::shared_ptr<TableBrowser> Open(QueryExecutor& Executor, const std::string& TableName);
+
+	TableBrowser(QueryExecutor& Executor, const std::string& TableName);
+
+	TableBrowser(const TableBrowser& copy) = delete;
+	TableBrowser(const TableBrowser&& Rhs) = delete;
+	TableBrowser& operator=(const TableBrowser& Rhs) = delete;
+	TableBrowser& operator=(const TableBrowser&& Rhs) = delete;
+
+	const std::string& GetTableName() const { return mTableName; }
+
+	// the columns below are only valid once the schema lookup has finished
+	bool IsReady() const { return mReady.load(); }
+	int GetColumns() const { return static_cast<int>(mColumnNames.size()); }
+	const char* GetColumnName(int Column) const { return mColumnNames[Column].c_str(); }
+	// the key pages are ordered by, or empty when the table has none and pages fall back to OFFSET
+	const std::string& GetKeyColumns() const { return mKeyColumns; }
+
+	int64_t GetKnownRows() const { return mKnownRows.load(); }
+	bool IsRowCountKnown() const { return mRowCountKnown.load(); }
+	// bytes held by the rowid index so far; zero for tables not keyed by rowid
+	size_t GetRowidIndexMemoryUsage() const { return mRowidIndexBytes.load(); }
+
+	// returns nullptr and queues a fetch when the page is not resident; the pages either side
+	// are prefetched so Prev/Next and small scrolls never wait
+	ResultPagePtr GetPage(int64_t PageIndex);
+	ResultPagePtr GetPageForRow(int64_t Row) { return GetPage(Row / PageSize); }
+
+	// Returns a page holding Row, or nullptr while it is fetched. Rowid tables look the row up
+	// through the rowid index and read just that row, plus a ring of neighbours for Prev/Next;
+	// other tables fall back to the row's page. A row the lookup didn't find comes back as an
+	// empty page.
+	ResultPagePtr GetRecord(int64_t Row);
+
+	std::string GetErrorMessage() const;
+
+private:
+
+	struct ValueDeleter
+	{
+		void operator()(sqlite3_value* Value) const;
+	};
+	// Keys are kept as SQLite values so each binds back with the storage class it was read
+	// with; a ResultSet column would turn the keys of a mixed-type column into text.
+	using KeyValue = std::unique_ptr<sqlite3_value, ValueDeleter>;
+
+	// worker thread only
+	void Describe(StatementCache& Statements);
+	void FetchPage(StatementCache& Statements, int64_t PageIndex);
+	bool ExtendPageIndex(StatementCache& Statements);
+	void FetchRecords(StatementCache& Statements, const std::vector<int64_t>& Rows);
+	bool CountRows(StatementCache& Statements);
+	void AppendKey(std::vector<KeyValue>& Keys, sqlite3_stmt& Statement, int FirstColumn) const;
+	void BindKey(sqlite3_stmt& Statement, const std::vector<KeyValue>& Keys, size_t Row) const;
+	int64_t GetIndexedPages() const { return static_cast<int64_t>(mPageEnds.size() / mNumKeys); }
+
+	void RequestPage(int64_t PageIndex);
+	void PublishPage(ResultPagePtr Page);
+	void SetError(const char* Message);
+	void SetRowCount(int64_t Rows);
+	void UpdateKnownRows(int64_t Rows);
+
+	QueryExecutor& mExecutor;
+	const std::string mTableName;
+
+	std::atomic<bool> mReady;
+	std::vector<std::string> mColumnNames;
+	std::string mKeyColumns;
+	std::atomic<int64_t> mKnownRows;
+	std::atomic<bool> mRowCountKnown;
+	std::atomic<size_t> mRowidIndexBytes;
+
+	mutable std::mutex mMutex;
+	std::map<int64_t, ResultPagePtr> mResidentPages;
+	std::vector<int64_t> mRequestedPages;
+	int64_t mLastRequestedPage = 0;
+	std::map<int64_t, ResultPagePtr> mRecords;
+	std::vector<int64_t> mRequestedRecords;
+	int64_t mLastRequestedRecord = 0;
+	std::string mErrorMessage;
+
+	// built by Describe, then read-only
+	int mNumKeys = 0;
+	bool mRowidKeyed = false;
+	std::string mFirstPageQuery;
+	std::string mNextPageQuery;
+	std::string mFirstIndexQuery;
+	std::string mNextIndexQuery;
+	std::string mRecordQuery;
+
+	// worker thread only: mNumKeys values per page, the key of the page's last row. The scan that
+	// builds it resumes after the last key it saw, and also fills the rowid index for rowid tables.
+	std::vector<KeyValue> mPageEnds;
+	RowidIndex mRowids;
+	std::vector<KeyValue> mLastScannedKey;
+	int64_t mScannedRows = 0;
+	bool mPageIndexComplete = false;
+};
@@ -0,0 +1,176 @@
+#include "Arena.h"
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace
+{
+	// Chunks start at the smallest block the OS hands out, so one-row results stay cheap, and
+	// double up to the largest size. VirtualAlloc reserves address space in 64 KB granules, so
+	// anything smaller would leave the rest of the granule unusable.
+#ifdef _WIN32
+	constexpr size_t MinChunkSize = 64 * 1024;
+#else
+	constexpr size_t MinChunkSize = 4 * 1024;
+#endif
+	constexpr size_t MaxChunkSize = 4 * 1024 * 1024;
+
+	std::atomic<size_t> TotalChunks{ 0 };
+	std::atomic<size_t> TotalBytesReserved{ 0 };
+
+	// whole pages from the OS rather than the heap, so releasing a chunk always unmaps it
+	void* MapChunk(size_t Size)
+	{
+#ifdef _WIN32
+		return VirtualAlloc(nullptr, Size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+		void* Memory = mmap(nullptr, Size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		return Memory == MAP_FAILED ? nullptr : Memory;
+#endif
+	}
+
+	void UnmapChunk(void* Memory, size_t Size)
+	{
+#ifdef _WIN32
+		(void)Size;
+		VirtualFree(Memory, 0, MEM_RELEASE);
+#else
+		munmap(Memory, Size);
+#endif
+	}
+}
+
+Arena::~Arena()
+{
+	Reset();
+}
+
+Arena::Arena(Arena&& Rhs) noexcept
+	: mChunks(std::move(Rhs.mChunks))
+	, mCursor(Rhs.mCursor)
+	, mEnd(Rhs.mEnd)
+	, mNextChunkSize(Rhs.mNextChunkSize)
+	, mStats(Rhs.mStats)
+{
+	Rhs.mChunks.clear();
+	Rhs.mCursor = Rhs.mEnd = nullptr;
+	Rhs.mNextChunkSize = 0;
+	Rhs.mStats = Stats();
+}
+
+Arena& Arena::operator=(Arena&& Rhs) noexcept
+{
+	if (this != &Rhs)
+	{
+		Reset();
+		std::swap(mChunks, Rhs.mChunks);
+		std::swap(mCursor, Rhs.mCursor);
+		std::swap(mEnd, Rhs.mEnd);
+		std::swap(mNextChunkSize, Rhs.mNextChunkSize);
+		std::swap(mStats, Rhs.mStats);
+	}
+	return *this;
+}
+
+void* Arena::Allocate(size_t Size, size_t Alignment)
+{
+	mStats.Allocations++;
+	mStats.BytesUsed += Size;
+
+	uint8_t* Aligned = reinterpret_cast<uint8_t*>((reinterpret_cast<uintptr_t>(mCursor) + Alignment - 1) & ~uintptr_t(Alignment - 1));
+	if (mCursor && Aligned + Size <= mEnd)
+	{
+		mCursor = Aligned + Size;
+		return Aligned;
+	}
+
+	// a block over half a chunk gets a chunk of its own and the current one stays in use, without
+	// growing the next chunk; chunks are page aligned, which covers any alignment asked for
+	const size_t ChunkSize = std::min(std::max(mNextChunkSize * 2, MinChunkSize), MaxChunkSize);
+	if (Size > ChunkSize / 2)
+	{
+		return AllocateChunk((Size + MinChunkSize - 1) / MinChunkSize * MinChunkSize);
+	}
+
+	mNextChunkSize = ChunkSize;
+	mCursor = AllocateChunk(mNextChunkSize);
+	mEnd = mCursor + mNextChunkSize;
+	mCursor += Size;
+	return mCursor - Size;
+}
+
+std::string_view Arena::Store(std::string_view Bytes)
+{
+	if (Bytes.empty())
+	{
+		return std::string_view("", 0);
+	}
+	char* Copy = static_cast<char*>(Allocate(Bytes.size() + 1, 1));
+	memcpy(Copy, Bytes.data(), Bytes.size());
+	Copy[Bytes.size()] = '\0';
+	return std::string_view(Copy, Bytes.size());
+}
+
+void Arena::Adopt(Arena& Other)
+{
+	mChunks.insert(mChunks.end(), Other.mChunks.begin(), Other.mChunks.end());
+	mStats.Allocations += Other.mStats.Allocations;
+	mStats.BytesUsed += Other.mStats.BytesUsed;
+	mStats.BytesReserved += Other.mStats.BytesReserved;
+	mStats.Chunks += Other.mStats.Chunks;
+
+	Other.mChunks.clear();
+	Other.mCursor = Other.mEnd = nullptr;
+	Other.mNextChunkSize = 0;
+	Other.mStats = Stats();
+}
+
+void Arena::Reset()
+{
+	for (const Chunk& Block : mChunks)
+	{
+		UnmapChunk(Block.Data, Block.Size);
+	}
+	TotalChunks -= mChunks.size();
+	TotalBytesReserved -= mStats.BytesReserved;
+
+	mChunks.clear();
+	mCursor = mEnd = nullptr;
+	mNextChunkSize = 0;
+	mStats = Stats();
+}
+
+size_t Arena::GetTotalChunks()
+{
+	return TotalChunks.load();
+}
+
+size_t Arena::GetTotalBytesReserved()
+{
+	return TotalBytesReserved.load();
+}
+
+uint8_t* Arena::AllocateChunk(size_t Size)
+{
+	void* Memory = MapChunk(Size);
+	if (!Memory)
+	{
+		throw std::bad_alloc();
+	}
+
+	mChunks.push_back({ static_cast<uint8_t*>(Memory), Size });
+	mStats.BytesReserved += Size;
+	mStats.Chunks++;
+	TotalChunks++;
+	TotalBytesReserved += Size;
+	return static_cast<uint8_t*>(Memory);
+}
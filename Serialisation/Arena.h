@@ -0,0 +1,64 @@
+#pragma once
+
+#include <string_view>
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+// Bump-pointer allocator for data that is built up and dropped together, such as the text cells
+// of a table or a result set. Allocations are carved out of chunks taken straight from the OS and
+// are never freed one at a time: every chunk goes back to the OS when the arena is reset or
+// destroyed, so dropping millions of cells is a handful of unmaps and leaves nothing resident.
+class Arena final
+{
+public:
+
+	struct Stats
+	{
+		size_t Allocations = 0;
+		size_t BytesUsed = 0;
+		size_t BytesReserved = 0;
+		size_t Chunks = 0;
+	};
+
+	Arena() = default;
+	~Arena();
+
+	Arena(const Arena& copy) = delete;
+	Arena& operator=(const Arena& Rhs) = delete;
+	// chunks move with the arena, so pointers into it stay valid
+	Arena(Arena&& Rhs) noexcept;
+	Arena& operator=(Arena&& Rhs) noexcept;
+
+	void* Allocate(size_t Size, size_t Alignment = alignof(max_align_t));
+
+	// a copy of Bytes followed by a zero that isn't part of the view; empty input isn't copied
+	std::string_view Store(std::string_view Bytes);
+
+	// takes over Other's chunks, for merging tables built in separate arenas
+	void Adopt(Arena& Other);
+
+	void Reset();
+
+	const Stats& GetStats() const { return mStats; }
+
+	// chunks and bytes held by every arena in the process
+	static size_t GetTotalChunks();
+	static size_t GetTotalBytesReserved();
+
+private:
+
+	struct Chunk
+	{
+		uint8_t* Data;
+		size_t Size;
+	};
+
+	uint8_t* AllocateChunk(size_t Size);
+
+	std::vector<Chunk> mChunks;
+	uint8_t* mCursor = nullptr;
+	uint8_t* mEnd = nullptr;
+	size_t mNextChunkSize = 0;
+	Stats mStats;
+};
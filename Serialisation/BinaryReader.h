@@ -1,33 +1,134 @@
 #pragma once
 
+#include <algorithm>
+#include <string_view>
 #include <stdint.h>
+#include <stddef.h>
+#include <string.h>
 
+class MappedFile;
+
+// Reads values from a block of memory it doesn't own. The Read* calls are bounds-checked and
+// return 0 without moving when too few bytes remain; the *Unchecked ones are for loops that have
+// already checked GetRemainingLength once for everything they read. Everything on the hot path is
+// inline and copies values out with memcpy, so data needn't be aligned. Plain reads are in host
+// byte order; ReadLittleEndian and ReadBigEndian are for formats that fix the order.
 class BinaryReader final
 {
 public:
 
 	explicit BinaryReader(const uint8_t* Data, size_t DataLength);
+	// reads the mapping in place; the file must stay open for as long as the reader is used
+	explicit BinaryReader(const MappedFile& File);
+
+	template <typename T>
+	T Read()
+	{
+		return CanRead(sizeof(T)) ? ReadUnchecked<T>() : T(0);
+	}
+
+	template <typename T>
+	T ReadUnchecked()
+	{
+		T Value;
+		memcpy(&Value, mData + mReadPosition, sizeof(T));
+		mReadPosition += sizeof(T);
+		return Value;
+	}
+
+	template <typename T>
+	T ReadLittleEndian()
+	{
+		return IsHostLittleEndian ? Read<T>() : ByteSwap(Read<T>());
+	}
 
-	uint8_t ReadUInt8();
-	uint32_t ReadUInt32();
-	int16_t ReadInt16();
-	uint16_t ReadUInt16();
-	int32_t ReadInt32();
-	uint64_t ReadUInt64();
-	int64_t ReadInt64();
+	template <typename T>
+	T ReadBigEndian()
+	{
+		return IsHostLittleEndian ? ByteSwap(Read<T>()) : Read<T>();
+	}
 
-	float ReadFloat32();
+	uint8_t ReadUInt8() { return Read<uint8_t>(); }
+	uint32_t ReadUInt32() { return Read<uint32_t>(); }
+	int16_t ReadInt16() { return Read<int16_t>(); }
+	uint16_t ReadUInt16() { return Read<uint16_t>(); }
+	int32_t ReadInt32() { return Read<int32_t>(); }
+	uint64_t ReadUInt64() { return Read<uint64_t>(); }
+	int64_t ReadInt64() { return Read<int64_t>(); }
+
+	float ReadFloat32() { return Read<float>(); }
 
 	void ReadBlob(void* DataDestination, size_t DataSize);
 
-	size_t GetReadPosition() const;
-	size_t GetDataLength() const;
+	// Size bytes viewed in place, or an empty view without moving when fewer remain
+	std::string_view ReadView(size_t Size)
+	{
+		if (!CanRead(Size))
+		{
+			return std::string_view();
+		}
+		const std::string_view View(reinterpret_cast<const char*>(mData + mReadPosition), Size);
+		mReadPosition += Size;
+		return View;
+	}
+
+	// The bytes before the next Delimiter, which is skipped; without one, the rest of the data.
+	// Finds with memchr rather than a read per byte.
+	std::string_view ReadUntil(uint8_t Delimiter)
+	{
+		const size_t End = Find(Delimiter);
+		const std::string_view View(reinterpret_cast<const char*>(mData + mReadPosition), End - mReadPosition);
+		mReadPosition = std::min(End + 1, mDataLength);
+		return View;
+	}
+
+	// offset of the next Byte at or after the read position, or GetDataLength() when there is none
+	size_t Find(uint8_t Byte) const
+	{
+		const void* Found = GetRemainingLength() > 0 ? memchr(mData + mReadPosition, Byte, GetRemainingLength()) : nullptr;
+		return Found ? static_cast<const uint8_t*>(Found) - mData : mDataLength;
+	}
+
+	// moves to the next Byte, or to the end when there is none
+	bool SkipTo(uint8_t Byte)
+	{
+		mReadPosition = Find(Byte);
+		return mReadPosition < mDataLength;
+	}
+
+	bool CanRead(size_t Size) const { return Size <= mDataLength - mReadPosition; }
+
+	const uint8_t* GetData() const { return mData; }
+	size_t GetReadPosition() const { return mReadPosition; }
+	size_t GetDataLength() const { return mDataLength; }
+
+	// the bytes from the read position on, for parsers that take a pointer and length
+	const uint8_t* GetRemainingData() const { return mData + mReadPosition; }
+	size_t GetRemainingLength() const { return mDataLength - mReadPosition; }
+	std::string_view GetRemaining() const { return std::string_view(reinterpret_cast<const char*>(GetRemainingData()), GetRemainingLength()); }
+
 	void Seek(size_t NewPosition);
 	void Advance(size_t AmountToSkip);
 
 private:
 
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	static constexpr bool IsHostLittleEndian = false;
+#else
+	static constexpr bool IsHostLittleEndian = true;
+#endif
+
+	template <typename T>
+	static T ByteSwap(T Value)
+	{
+		uint8_t Bytes[sizeof(T)];
+		memcpy(Bytes, &Value, sizeof(T));
+		std::reverse(Bytes, Bytes + sizeof(T));
+		memcpy(&Value, Bytes, sizeof(T));
+		return Value;
+	}
+
 	const uint8_t* mData;
 	size_t mDataLength;
 	size_t mReadPosition;
-};
\ No newline at end of file
+};
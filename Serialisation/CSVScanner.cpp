@@ -0,0 +1,370 @@
+#include "CSVScanner.h"
+#include <string.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CSV_SCANNER_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(CSV_SCANNER_X86) && !defined(_MSC_VER)
+#define CSV_SCANNER_TARGET(Isa) __attribute__((target(Isa)))
+#else
+#define CSV_SCANNER_TARGET(Isa)
+#endif
+
+namespace
+{
+	constexpr size_t BlockSize = 64;
+	constexpr char Newline = '\n';
+	constexpr char DoubleQuote = '\"';
+
+	// The last field of a CRLF row ends in the '\r'. The old text-mode ifstream read turned "\r\n"
+	// into "\n", so it's dropped here and no caller ever sees it.
+	std::string_view WithoutCarriageReturn(std::string_view Field)
+	{
+		if (!Field.empty() && Field.back() == '\r')
+		{
+			Field.remove_suffix(1);
+		}
+		return Field;
+	}
+
+	struct BlockMasks
+	{
+		uint64_t Quotes;
+		uint64_t Delimiters;
+		uint64_t Newlines;
+	};
+
+	using BlockMaskFunction = BlockMasks(*)(const uint8_t* Block, char Delimiter);
+
+	BlockMasks ScanBlockScalar(const uint8_t* Block, char Delimiter)
+	{
+		BlockMasks Masks = { 0, 0, 0 };
+		for (size_t Index = 0; Index < BlockSize; ++Index)
+		{
+			const uint64_t Bit = uint64_t(1) << Index;
+			const char Character = static_cast<char>(Block[Index]);
+			Masks.Quotes |= Character == DoubleQuote ? Bit : 0;
+			Masks.Delimiters |= Character == Delimiter ? Bit : 0;
+			Masks.Newlines |= Character == Newline ? Bit : 0;
+		}
+		return Masks;
+	}
+
+#ifdef CSV_SCANNER_X86
+	CSV_SCANNER_TARGET("sse2")
+	BlockMasks ScanBlockSSE2(const uint8_t* Block, char Delimiter)
+	{
+		const __m128i Quote = _mm_set1_epi8(DoubleQuote);
+		const __m128i Comma = _mm_set1_epi8(Delimiter);
+		const __m128i Line = _mm_set1_epi8(Newline);
+
+		BlockMasks Masks = { 0, 0, 0 };
+		for (size_t Offset = 0; Offset < BlockSize; Offset += 16)
+		{
+			const __m128i Bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Block + Offset));
+			Masks.Quotes |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(Bytes, Quote)))) << Offset;
+			Masks.Delimiters |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(Bytes, Comma)))) << Offset;
+			Masks.Newlines |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(Bytes, Line)))) << Offset;
+		}
+		return Masks;
+	}
+
+	CSV_SCANNER_TARGET("avx2")
+	BlockMasks ScanBlockAVX2(const uint8_t* Block, char Delimiter)
+	{
+		const __m256i Quote = _mm256_set1_epi8(DoubleQuote);
+		const __m256i Comma = _mm256_set1_epi8(Delimiter);
+		const __m256i Line = _mm256_set1_epi8(Newline);
+
+		BlockMasks Masks = { 0, 0, 0 };
+		for (size_t Offset = 0; Offset < BlockSize; Offset += 32)
+		{
+			const __m256i Bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(Block + Offset));
+			Masks.Quotes |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(Bytes, Quote)))) << Offset;
+			Masks.Delimiters |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(Bytes, Comma)))) << Offset;
+			Masks.Newlines |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(Bytes, Line)))) << Offset;
+		}
+		return Masks;
+	}
+
+	bool SupportsAVX2()
+	{
+#ifdef _MSC_VER
+		int Registers[4];
+		__cpuid(Registers, 0);
+		if (Registers[0] < 7)
+		{
+			return false;
+		}
+		__cpuid(Registers, 1);
+		const bool OSXSave = (Registers[2] & (1 << 27)) != 0;
+		const bool AVX = (Registers[2] & (1 << 28)) != 0;
+		// the OS must also save the upper halves of the YMM registers on context switch
+		if (!OSXSave || !AVX || (_xgetbv(0) & 6) != 6)
+		{
+			return false;
+		}
+		__cpuidex(Registers, 7, 0);
+		return (Registers[1] & (1 << 5)) != 0;
+#else
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+#endif
+
+	CSVScanner::InstructionSet DetectInstructionSet()
+	{
+#ifdef CSV_SCANNER_X86
+		if (SupportsAVX2())
+		{
+			return CSVScanner::InstructionSet::AVX2;
+		}
+		return CSVScanner::InstructionSet::SSE2;
+#else
+		return CSVScanner::InstructionSet::Scalar;
+#endif
+	}
+
+	BlockMaskFunction GetBlockMaskFunction()
+	{
+		static const BlockMaskFunction Function = []() -> BlockMaskFunction
+		{
+			switch (CSVScanner::GetInstructionSet())
+			{
+#ifdef CSV_SCANNER_X86
+			case CSVScanner::InstructionSet::AVX2:
+				return &ScanBlockAVX2;
+			case CSVScanner::InstructionSet::SSE2:
+				return &ScanBlockSSE2;
+#endif
+			default:
+				return &ScanBlockScalar;
+			}
+		}();
+		return Function;
+	}
+
+	// bit i is set when an odd number of quotes sit at or before position i
+	uint64_t PrefixXor(uint64_t Bits)
+	{
+		Bits ^= Bits << 1;
+		Bits ^= Bits << 2;
+		Bits ^= Bits << 4;
+		Bits ^= Bits << 8;
+		Bits ^= Bits << 16;
+		Bits ^= Bits << 32;
+		return Bits;
+	}
+
+	int CountTrailingZeros(uint64_t Bits)
+	{
+#ifdef _MSC_VER
+		unsigned long Index;
+		_BitScanForward64(&Index, Bits);
+		return static_cast<int>(Index);
+#else
+		return __builtin_ctzll(Bits);
+#endif
+	}
+
+	int CountBits(uint64_t Bits)
+	{
+		// POPCNT isn't guaranteed on every SSE2 machine, so count with shifts and masks
+		Bits = Bits - ((Bits >> 1) & 0x5555555555555555ull);
+		Bits = (Bits & 0x3333333333333333ull) + ((Bits >> 2) & 0x3333333333333333ull);
+		Bits = (Bits + (Bits >> 4)) & 0x0f0f0f0f0f0f0f0full;
+		return static_cast<int>((Bits * 0x0101010101010101ull) >> 56);
+	}
+
+	// masks for the block at Offset; the last partial block is padded with zero bytes
+	BlockMasks ScanBlock(const uint8_t* Data, size_t Length, size_t Offset, char Delimiter)
+	{
+		if (Offset + BlockSize <= Length)
+		{
+			return GetBlockMaskFunction()(Data + Offset, Delimiter);
+		}
+
+		uint8_t Padded[BlockSize] = { 0 };
+		memcpy(Padded, Data + Offset, Length - Offset);
+		BlockMasks Masks = GetBlockMaskFunction()(Padded, Delimiter);
+
+		const uint64_t Valid = (uint64_t(1) << (Length - Offset)) - 1;
+		Masks.Quotes &= Valid;
+		Masks.Delimiters &= Valid;
+		Masks.Newlines &= Valid;
+		return Masks;
+	}
+
+	// sets InQuotes to the quoted region of the block and carries its state into the next one
+	uint64_t QuotedRegion(uint64_t Quotes, uint64_t& InQuotes)
+	{
+		const uint64_t Region = PrefixXor(Quotes) ^ InQuotes;
+		InQuotes = (Region >> 63) ? ~uint64_t(0) : 0;
+		return Region;
+	}
+}
+
+CSVScanner::InstructionSet CSVScanner::GetInstructionSet()
+{
+	static const InstructionSet Detected = DetectInstructionSet();
+	return Detected;
+}
+
+const char* CSVScanner::GetInstructionSetName(InstructionSet Set)
+{
+	switch (Set)
+	{
+	case InstructionSet::AVX2:
+		return "AVX2";
+	case InstructionSet::SSE2:
+		return "SSE2";
+	default:
+		return "Scalar";
+	}
+}
+
+CSVScanner::CSVScanner(const uint8_t* Data, size_t Length, char Delimiter)
+	: mData(Data)
+	, mLength(Length)
+	, mDelimiter(Delimiter)
+{
+}
+
+bool CSVScanner::NextField(std::string_view& OutField, bool& OutEndOfRow)
+{
+	while (mStructural == 0)
+	{
+		if (!LoadBlock())
+		{
+			if (mFinished)
+			{
+				return false;
+			}
+			mFinished = true;
+			OutField = WithoutCarriageReturn(std::string_view(reinterpret_cast<const char*>(mData) + mFieldStart, mLength - mFieldStart));
+			OutEndOfRow = true;
+			mFieldStart = mLength;
+			return true;
+		}
+	}
+
+	const size_t Position = mBlockStart + CountTrailingZeros(mStructural);
+	mStructural &= mStructural - 1;
+
+	OutField = std::string_view(reinterpret_cast<const char*>(mData) + mFieldStart, Position - mFieldStart);
+	OutEndOfRow = mData[Position] == Newline;
+	if (OutEndOfRow)
+	{
+		OutField = WithoutCarriageReturn(OutField);
+	}
+	mFieldStart = Position + 1;
+	return true;
+}
+
+bool CSVScanner::LoadBlock()
+{
+	if (mNextBlock >= mLength)
+	{
+		return false;
+	}
+
+	const BlockMasks Masks = ScanBlock(mData, mLength, mNextBlock, mDelimiter);
+	const uint64_t Quoted = QuotedRegion(Masks.Quotes, mInQuotes);
+	mStructural = (Masks.Delimiters | Masks.Newlines) & ~Quoted;
+	mBlockStart = mNextBlock;
+	mNextBlock += BlockSize;
+	return true;
+}
+
+size_t CSVScanner::CountLines(const uint8_t* Data, size_t Length, char Delimiter)
+{
+	size_t Lines = 0;
+	uint64_t InQuotes = 0;
+	for (size_t Offset = 0; Offset < Length; Offset += BlockSize)
+	{
+		const BlockMasks Masks = ScanBlock(Data, Length, Offset, Delimiter);
+		const uint64_t Quoted = QuotedRegion(Masks.Quotes, InQuotes);
+		Lines += CountBits(Masks.Newlines & ~Quoted);
+	}
+	return Lines;
+}
+
+size_t CSVScanner::CountQuotes(const uint8_t* Data, size_t Length)
+{
+	size_t Quotes = 0;
+	for (size_t Offset = 0; Offset < Length; Offset += BlockSize)
+	{
+		Quotes += CountBits(ScanBlock(Data, Length, Offset, ',').Quotes);
+	}
+	return Quotes;
+}
+
+size_t CSVScanner::FindRowStart(const uint8_t* Data, size_t Length, size_t Offset, bool InQuotes)
+{
+	uint64_t QuoteState = InQuotes ? ~uint64_t(0) : 0;
+	for (size_t Block = Offset; Block < Length; Block += BlockSize)
+	{
+		const BlockMasks Masks = ScanBlock(Data, Length, Block, ',');
+		const uint64_t Rows = Masks.Newlines & ~QuotedRegion(Masks.Quotes, QuoteState);
+		if (Rows != 0)
+		{
+			return Block + CountTrailingZeros(Rows) + 1;
+		}
+	}
+	return Length;
+}
+
+size_t CSVScanner::FindRowsEnd(const uint8_t* Data, size_t Length, size_t Rows)
+{
+	uint64_t InQuotes = 0;
+	for (size_t Offset = 0; Offset < Length && Rows > 0; Offset += BlockSize)
+	{
+		const BlockMasks Masks = ScanBlock(Data, Length, Offset, ',');
+		uint64_t Newlines = Masks.Newlines & ~QuotedRegion(Masks.Quotes, InQuotes);
+		const size_t BlockRows = CountBits(Newlines);
+		if (BlockRows < Rows)
+		{
+			Rows -= BlockRows;
+			continue;
+		}
+		while (--Rows > 0)
+		{
+			Newlines &= Newlines - 1;
+		}
+		return Offset + CountTrailingZeros(Newlines) + 1;
+	}
+	return Length;
+}
+
+std::string_view CSVScanner::Unquote(std::string_view Field, std::string& Scratch)
+{
+	if (Field.size() < 2 || Field.front() != DoubleQuote)
+	{
+		return Field;
+	}
+	if (Field.find(DoubleQuote, 1) == Field.size() - 1)
+	{
+		return Field.substr(1, Field.size() - 2);
+	}
+
+	Scratch.clear();
+	for (size_t Index = 1; Index < Field.size(); ++Index)
+	{
+		if (Field[Index] != DoubleQuote)
+		{
+			Scratch += Field[Index];
+		}
+		else if (Index + 1 < Field.size() && Field[Index + 1] == DoubleQuote)
+		{
+			Scratch += DoubleQuote;
+			++Index;
+		}
+	}
+	return Scratch;
+}
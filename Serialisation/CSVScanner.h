@@ -0,0 +1,67 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <stdint.h>
+#include <stddef.h>
+
+// Splits CSV text into fields 64 bytes at a time. Each block is reduced to bitmasks of quotes,
+// delimiters and newlines (AVX2, SSE2 or scalar, picked once at runtime), the quoted regions
+// are found with a prefix-xor over the quote mask, and the delimiters and newlines left outside
+// quotes are walked with count-trailing-zeros. Fields are returned as raw views of the input:
+// quotes are kept, exactly as the byte-at-a-time parser used to keep them. The '\r' of a CRLF
+// line ending is not part of the row's last field.
+class CSVScanner final
+{
+public:
+
+	enum class InstructionSet
+	{
+		Scalar,
+		SSE2,
+		AVX2,
+	};
+
+	static InstructionSet GetInstructionSet();
+	static const char* GetInstructionSetName(InstructionSet Set);
+
+	CSVScanner(const uint8_t* Data, size_t Length, char Delimiter = ',');
+
+	// Returns false once the input is exhausted. The last field of the input is always returned,
+	// even when empty, so a trailing newline yields one empty field on a row of its own.
+	bool NextField(std::string_view& OutField, bool& OutEndOfRow);
+
+	// offset just past the last field returned
+	size_t GetPosition() const { return mFieldStart; }
+
+	// newlines outside quotes, counted a block at a time without splitting fields
+	static size_t CountLines(const uint8_t* Data, size_t Length, char Delimiter = ',');
+
+	// Used to split the input into chunks that start on a row: the parity of the quotes before
+	// an offset says whether it sits inside a quoted field, and the row starts after the first
+	// newline outside quotes from there on. Returns Length when no row starts at or after Offset.
+	static size_t CountQuotes(const uint8_t* Data, size_t Length);
+	static size_t FindRowStart(const uint8_t* Data, size_t Length, size_t Offset, bool InQuotes);
+
+	// offset just past the Rows-th newline outside quotes, or Length when the input has fewer
+	static size_t FindRowsEnd(const uint8_t* Data, size_t Length, size_t Rows);
+
+	// A quoted field without its quotes and with each doubled quote made single. Unquoted fields
+	// and quoted ones with nothing to unescape are returned as views; the rest are built in Scratch.
+	static std::string_view Unquote(std::string_view Field, std::string& Scratch);
+
+private:
+
+	bool LoadBlock();
+
+	const uint8_t* mData;
+	size_t mLength;
+	char mDelimiter;
+
+	size_t mBlockStart = 0;
+	size_t mNextBlock = 0;
+	uint64_t mStructural = 0;
+	uint64_t mInQuotes = 0;
+	size_t mFieldStart = 0;
+	bool mFinished = false;
+};
@@ -0,0 +1,232 @@
+#include "CSVSniffer.h"
+#include "CSVScanner.h"
+#include <algorithm>
+#include <map>
+#include <random>
+
+namespace
+{
+	using SampleRow = std::vector<std::string_view>;
+
+	// Rows of Data[Start, End). Unless the block runs to the end of the input its last row is cut
+	// short, so it's dropped; blank lines are skipped. The scanner has already taken the '\r' off
+	// the last field of CRLF rows, so they type and count like LF rows.
+	std::vector<SampleRow> ReadRows(const uint8_t* Data, size_t Length, size_t Start, size_t End, char Delimiter)
+	{
+		std::vector<SampleRow> Rows;
+		CSVScanner Scanner(Data + Start, End - Start, Delimiter);
+		SampleRow Row;
+		std::string_view Field;
+		bool EndOfRow = false;
+		while (Scanner.NextField(Field, EndOfRow))
+		{
+			Row.push_back(Field);
+			if (EndOfRow)
+			{
+				Rows.push_back(std::move(Row));
+				Row.clear();
+			}
+		}
+		if (End < Length && !Rows.empty())
+		{
+			Rows.pop_back();
+		}
+		Rows.erase(std::remove_if(Rows.begin(), Rows.end(), [](const SampleRow& Fields)
+		{
+			return Fields.size() == 1 && Fields[0].empty();
+		}), Rows.end());
+		return Rows;
+	}
+
+	// the field count most rows have, and the share of rows that have it
+	size_t GetUsualFieldCount(const std::vector<SampleRow>& Rows, double& OutConsistency)
+	{
+		std::map<size_t, size_t> RowsPerCount;
+		for (const SampleRow& Row : Rows)
+		{
+			RowsPerCount[Row.size()]++;
+		}
+
+		size_t Usual = 0;
+		size_t UsualRows = 0;
+		for (const auto& [Count, NumRows] : RowsPerCount)
+		{
+			if (NumRows > UsualRows)
+			{
+				Usual = Count;
+				UsualRows = NumRows;
+			}
+		}
+		OutConsistency = Rows.empty() ? 0.0 : static_cast<double>(UsualRows) / static_cast<double>(Rows.size());
+		return Usual;
+	}
+
+	std::string GetColumnName(std::string_view Field, size_t Column)
+	{
+		std::string Scratch;
+		const std::string_view Name = CSVScanner::Unquote(Field, Scratch);
+		return Name.empty() ? "Column" + std::to_string(Column + 1) : std::string(Name);
+	}
+}
+
+CSVSniffer::Result CSVSniffer::Sniff(const uint8_t* Data, size_t Length)
+{
+	return Sniff(Data, Length, Options());
+}
+
+CSVSniffer::Result CSVSniffer::Sniff(const uint8_t* Data, size_t Length, const Options& Settings)
+{
+	Result Sniffed;
+	if (!Data || Length == 0)
+	{
+		return Sniffed;
+	}
+
+	// Block offsets: the head, then, for a file big enough that they don't overlap, one block at a
+	// random offset in each of RandomBlocks equal stretches between head and tail, then the tail.
+	// Blocks after the head start on the first newline from their offset; one that turns out to
+	// have started inside a quoted field is thrown away below.
+	const size_t BlockBytes = std::max<size_t>(Settings.BlockBytes, 1);
+	std::vector<std::pair<size_t, size_t>> Blocks;
+	if (Length <= BlockBytes * (Settings.RandomBlocks + 2))
+	{
+		Blocks.emplace_back(0, Length);
+	}
+	else
+	{
+		Blocks.emplace_back(0, BlockBytes);
+		const size_t Stretch = (Length - 2 * BlockBytes) / std::max<size_t>(Settings.RandomBlocks, 1);
+		std::mt19937_64 Random(Settings.Seed);
+		for (size_t Block = 0; Block < Settings.RandomBlocks; ++Block)
+		{
+			const size_t Offset = BlockBytes + Block * Stretch + static_cast<size_t>(Random() % (Stretch - BlockBytes + 1));
+			const size_t Start = CSVScanner::FindRowStart(Data, Length, Offset, false);
+			Blocks.emplace_back(Start, std::min(Start + BlockBytes, Length));
+		}
+		const size_t TailStart = CSVScanner::FindRowStart(Data, Length, Length - BlockBytes, false);
+		Blocks.emplace_back(TailStart, Length);
+	}
+
+	// the delimiter that splits the head's rows into the most consistent number of fields
+	double BestConsistency = -1.0;
+	size_t NumColumns = 0;
+	for (const char Candidate : Settings.Delimiters)
+	{
+		double Consistency = 0.0;
+		const size_t FieldCount = GetUsualFieldCount(ReadRows(Data, Length, Blocks[0].first, Blocks[0].second, Candidate), Consistency);
+		if (FieldCount > 1 && Consistency > BestConsistency)
+		{
+			BestConsistency = Consistency;
+			Sniffed.Delimiter = Candidate;
+			NumColumns = FieldCount;
+		}
+	}
+
+	std::vector<SampleRow> HeadRows = ReadRows(Data, Length, Blocks[0].first, Blocks[0].second, Sniffed.Delimiter);
+	if (HeadRows.empty())
+	{
+		return Sniffed;
+	}
+	// the first record decides the column count, as it does for a full parse
+	NumColumns = HeadRows[0].size();
+	const SampleRow FirstRow = HeadRows[0];
+	HeadRows.erase(HeadRows.begin());
+
+	std::vector<Column> Columns(NumColumns);
+	auto SampleRows = [&](const std::vector<SampleRow>& Rows)
+	{
+		for (const SampleRow& Row : Rows)
+		{
+			if (Row.size() != NumColumns)
+			{
+				continue;
+			}
+			for (size_t Index = 0; Index < NumColumns; ++Index)
+			{
+				const ColumnDataType Type = GetCellType(Row[Index]);
+				Columns[Index].Type = WidenType(Columns[Index].Type, Type);
+				Columns[Index].Nullable = Columns[Index].Nullable || Type == ColumnDataType::Unknown;
+			}
+			Sniffed.SampledRows++;
+		}
+	};
+
+	SampleRows(HeadRows);
+	Sniffed.SampledBytes = Blocks[0].second - Blocks[0].first;
+	for (size_t Block = 1; Block < Blocks.size(); ++Block)
+	{
+		const std::vector<SampleRow> Rows = ReadRows(Data, Length, Blocks[Block].first, Blocks[Block].second, Sniffed.Delimiter);
+		const size_t Matching = std::count_if(Rows.begin(), Rows.end(), [&](const SampleRow& Row) { return Row.size() == NumColumns; });
+		if (Matching * 2 < Rows.size())
+		{
+			// most rows don't fit: the block most likely started inside a quoted field
+			continue;
+		}
+		SampleRows(Rows);
+		Sniffed.SampledBytes += Blocks[Block].second - Blocks[Block].first;
+	}
+
+	// The first record is a header if it has text over a numeric column. One with numbers over
+	// numeric columns is data; with nothing numeric to go by it is taken as a header, as a full
+	// parse always takes it.
+	bool TextOverNumbers = false;
+	bool NumbersOverNumbers = false;
+	for (size_t Index = 0; Index < NumColumns; ++Index)
+	{
+		if (Columns[Index].Type != ColumnDataType::Integer && Columns[Index].Type != ColumnDataType::Real)
+		{
+			continue;
+		}
+		const ColumnDataType FirstType = GetCellType(FirstRow[Index]);
+		TextOverNumbers = TextOverNumbers || FirstType == ColumnDataType::Text;
+		NumbersOverNumbers = NumbersOverNumbers || FirstType == ColumnDataType::Integer || FirstType == ColumnDataType::Real;
+	}
+	Sniffed.HasHeader = TextOverNumbers || !NumbersOverNumbers;
+
+	if (Sniffed.HasHeader)
+	{
+		CSVScanner Scanner(Data, Length, Sniffed.Delimiter);
+		std::string_view Field;
+		bool EndOfRow = false;
+		while (Scanner.NextField(Field, EndOfRow) && !EndOfRow)
+		{
+		}
+		Sniffed.DataStart = Scanner.GetPosition();
+	}
+	else
+	{
+		SampleRows({ FirstRow });
+	}
+
+	for (size_t Index = 0; Index < NumColumns; ++Index)
+	{
+		Columns[Index].Name = Sniffed.HasHeader ? GetColumnName(FirstRow[Index], Index) : "Column" + std::to_string(Index + 1);
+	}
+	Sniffed.Columns = std::move(Columns);
+	return Sniffed;
+}
+
+ColumnDataType CSVSniffer::WidenType(ColumnDataType Current, ColumnDataType Cell)
+{
+	// the enum is ordered from narrowest to widest
+	return std::max(Current, Cell);
+}
+
+ColumnDataType CSVSniffer::GetCellType(std::string_view Cell)
+{
+	int64_t IntegerValue = 0;
+	double RealValue = 0.0;
+	if (Cell.empty())
+	{
+		return ColumnDataType::Unknown;
+	}
+	if (TypedDataTable::ParseInteger(Cell, IntegerValue))
+	{
+		return ColumnDataType::Integer;
+	}
+	if (TypedDataTable::ParseReal(Cell, RealValue))
+	{
+		return ColumnDataType::Real;
+	}
+	return ColumnDataType::Text;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "DataTable.h"
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+// Guesses a CSV file's layout from a few blocks of it rather than the whole: the head, the tail
+// and blocks picked at random in between. Cells are typed by the same rules TypedDataTable uses,
+// so a column the sample calls INTEGER is one a full parse would too unless a row outside the
+// sample disagrees; WidenType is how a caller folds such a row in afterwards.
+class CSVSniffer final
+{
+public:
+
+	struct Options
+	{
+		// bytes read from the head, the tail and each random block
+		size_t BlockBytes = 64 * 1024;
+		size_t RandomBlocks = 8;
+		// the same file always yields the same sample
+		uint32_t Seed = 0;
+		// tried in order, the first of equally good candidates wins
+		std::string Delimiters = ",;\t|";
+	};
+
+	struct Column
+	{
+		std::string Name;
+		ColumnDataType Type = ColumnDataType::Unknown;
+		// an empty cell was seen
+		bool Nullable = false;
+	};
+
+	struct Result
+	{
+		char Delimiter = ',';
+		bool HasHeader = true;
+		std::vector<Column> Columns;
+		// offset of the first data row, past the header when there is one
+		size_t DataStart = 0;
+		size_t SampledRows = 0;
+		size_t SampledBytes = 0;
+	};
+
+	// Columns are named after the header, unquoted, or Column1, Column2... without one. An empty
+	// input yields no columns.
+	static Result Sniff(const uint8_t* Data, size_t Length);
+	static Result Sniff(const uint8_t* Data, size_t Length, const Options& Settings);
+
+	// the narrowest type that holds cells of both types: integer -> real -> text
+	static ColumnDataType WidenType(ColumnDataType Current, ColumnDataType Cell);
+
+	// what TypedDataTable would type this one cell as; empty cells are Unknown
+	static ColumnDataType GetCellType(std::string_view Cell);
+};
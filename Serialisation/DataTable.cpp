@@ -1,14 +1,81 @@
 
 #include "DataTable.h"
 #include "BinaryReader.h"
-#include <stdexcept>
-#include <sstream>
+#include "CSVScanner.h"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <future>
+#include <thread>
+
+namespace
+{
+	// Runs Work(Chunk) for every chunk, one thread each. While they run, ReportProgress is called
+	// from the calling thread every few milliseconds. A single chunk with no progress to report
+	// runs on the calling thread, as the importer's batch parses do several times per batch.
+	template <typename Function>
+	void RunChunks(size_t NumChunks, const std::function<void()>& ReportProgress, Function Work)
+	{
+		if (NumChunks == 1 && !ReportProgress)
+		{
+			Work(size_t(0));
+			return;
+		}
+
+		std::vector<std::future<void>> Workers;
+		Workers.reserve(NumChunks);
+		for (size_t Chunk = 0; Chunk < NumChunks; ++Chunk)
+		{
+			Workers.push_back(std::async(std::launch::async, Work, Chunk));
+		}
+
+		for (auto& Worker : Workers)
+		{
+			while (ReportProgress && Worker.wait_for(std::chrono::milliseconds(16)) != std::future_status::ready)
+			{
+				ReportProgress();
+			}
+			Worker.get();
+		}
+	}
+
+	// std::stoi and std::stof skipped leading whitespace and took a leading '+', so the same
+	// cells still count as numbers; the whole of the rest must parse for the cell to be numeric
+	std::string_view NumberText(std::string_view Text)
+	{
+		const size_t Start = Text.find_first_not_of(" \t\n\v\f\r");
+		Text.remove_prefix(Start == std::string_view::npos ? Text.size() : Start);
+		if (Text.size() > 1 && Text[0] == '+' && Text[1] != '-')
+		{
+			Text.remove_prefix(1);
+		}
+		return Text;
+	}
+
+	// fields in the first record, read with the same quoting rules as the rest of the file
+	size_t CountCSVColumns(const uint8_t* Data, size_t Length, char Delimiter = ',')
+	{
+		CSVScanner Scanner(Data, Length, Delimiter);
+		size_t NumColumns = 0;
+		std::string_view Field;
+		bool EndOfRow = false;
+		while (Scanner.NextField(Field, EndOfRow))
+		{
+			NumColumns++;
+			if (EndOfRow)
+			{
+				break;
+			}
+		}
+		return NumColumns;
+	}
+}
 
 DataTable::DataTable()
 {
 }
 
-const std::string *const  DataTable::GetCell(size_t Row, size_t Column)const
+const std::string* DataTable::GetCell(size_t Row, size_t Column) const
 {
 	if (GetNumRows() > Row && GetNumColumns() > Column)
 	{
@@ -76,86 +143,120 @@ size_t DataTable::GetSizeInBytesAsCSV() const
 	
 DataTablePtr DataTable::CreateFromCSV(BinaryReader & Reader)
 {
-	constexpr char CarriageReturn = '\n';
-	constexpr char Comma = ',';
-	constexpr char DoubleQuote = '\"';
-	size_t StartOfBuffer = Reader.GetReadPosition();
-	size_t NumColumns = 0;
-	size_t NumRows = 0;
-	size_t MaxLengthRow = 0;
-	size_t CurrentLengthRow = 0;
-	char Character = (char)Reader.ReadUInt8();
-
-	NumRows++;
-	NumColumns++;
-	while (Character != CarriageReturn && Character != DoubleQuote && Reader.GetReadPosition() < Reader.GetDataLength())
-	{
-		CurrentLengthRow++;
-		if (Character == Comma)
-		{
-			MaxLengthRow = std::max(CurrentLengthRow, MaxLengthRow);
-			CurrentLengthRow = 0;
-			NumColumns++;
-		}
-		Character = (char)Reader.ReadUInt8();
+	const uint8_t* Data = Reader.GetRemainingData();
+	const size_t Length = Reader.GetRemainingLength();
+	const size_t NumColumns = CountCSVColumns(Data, Length);
+	const size_t NumRows = CSVScanner::CountLines(Data, Length) + 1;
+
+	DataTablePtr NewTable = std::make_shared<DataTable>();
+	NewTable->mTable.resize(NumRows);
+	for (auto& Column : NewTable->mTable)
+	{
+		Column.resize(NumColumns);
 	}
-	NumRows++;
-	while (Reader.GetReadPosition() < Reader.GetDataLength())
+
+	CSVScanner Scanner(Data, Length);
+	size_t RowIndex = 0;
+	size_t ColumnIndex = 0;
+	std::string_view Field;
+	bool EndOfRow = false;
+	while (Scanner.NextField(Field, EndOfRow))
 	{
-		Character = (char)Reader.ReadUInt8();
-		CurrentLengthRow++;
+		if (ColumnIndex < NumColumns)
+		{
+			NewTable->mTable[RowIndex][ColumnIndex].assign(Field.data(), Field.size());
+		}
 
-		if (Character == CarriageReturn)
+		if (EndOfRow)
+		{
+			ColumnIndex = 0;
+			RowIndex++;
+		}
+		else
 		{
-			NumRows++;
-			MaxLengthRow = std::max(CurrentLengthRow, MaxLengthRow);
-			CurrentLengthRow = 0;
+			ColumnIndex++;
 		}
 	}
 
-	DataTablePtr NewTable = std::make_shared<DataTable>();
-	NewTable->mTable.resize(NumRows);
-	for (auto& Column : NewTable->mTable)
+	Reader.Seek(Reader.GetDataLength());
+	return NewTable;
+}
+
+std::string_view ColumnarDataTable::GetCell(size_t Row, size_t ColumnIndex) const
+{
+	if (ColumnIndex >= mColumns.size() || Row >= mNumRows)
 	{
-		Column.resize(NumColumns);
+		return std::string_view();
 	}
 
-	Reader.Seek(StartOfBuffer);
+	const Column& Cells = mColumns[ColumnIndex];
+	const uint64_t Offset = Cells.Offsets[Row];
+	if (Offset & ArenaOffset)
+	{
+		return mUnescaped[Offset & ~ArenaOffset];
+	}
+	return std::string_view(mSource + Offset, Cells.Lengths[Row]);
+}
+
+size_t ColumnarDataTable::GetMemoryUsage() const
+{
+	size_t Bytes = mArena.GetStats().BytesReserved + mUnescaped.capacity() * sizeof(std::string_view);
+	for (const Column& Cells : mColumns)
+	{
+		Bytes += Cells.Offsets.capacity() * sizeof(uint64_t) + Cells.Lengths.capacity() * sizeof(uint32_t);
+	}
+	return Bytes;
+}
+
+ColumnarDataTablePtr ColumnarDataTable::CreateFromCSV(BinaryReader& Reader)
+{
+	const uint8_t* Data = Reader.GetRemainingData();
+	const size_t Length = Reader.GetRemainingLength();
+
+	ColumnarDataTablePtr NewTable = std::make_shared<ColumnarDataTable>();
+	NewTable->mSource = reinterpret_cast<const char*>(Data);
+	NewTable->mNumRows = CSVScanner::CountLines(Data, Length) + 1;
+	NewTable->mColumns.resize(CountCSVColumns(Data, Length));
+	for (Column& Cells : NewTable->mColumns)
+	{
+		// short rows leave their missing cells empty
+		Cells.Offsets.resize(NewTable->mNumRows, 0);
+		Cells.Lengths.resize(NewTable->mNumRows, 0);
+	}
 
-	bool CaptureWholeStream = false;
+	CSVScanner Scanner(Data, Length);
+	std::string Scratch;
 	size_t RowIndex = 0;
 	size_t ColumnIndex = 0;
-	std::string TempData;
-	TempData.reserve(MaxLengthRow);
-	while (Reader.GetReadPosition() < Reader.GetDataLength())
+	std::string_view Field;
+	bool EndOfRow = false;
+	while (Scanner.NextField(Field, EndOfRow))
 	{
-		Character = (char)Reader.ReadUInt8();
-		if (Character == DoubleQuote)
+		if (ColumnIndex < NewTable->mColumns.size())
 		{
-			CaptureWholeStream = !CaptureWholeStream;
-		}
-		if (!CaptureWholeStream)
-		{
-			if (Character == Comma)
-			{
-				NewTable->mTable[RowIndex][ColumnIndex] = TempData.data();
-				ColumnIndex++;
-				TempData.clear();
-				continue;
-			}
-			else if (Character == CarriageReturn)
+			const std::string_view Cell = CSVScanner::Unquote(Field, Scratch);
+			uint64_t Offset = Cell.data() - NewTable->mSource;
+			if (Cell.data() == Scratch.data())
 			{
-				NewTable->mTable[RowIndex][ColumnIndex] = TempData.data();
-				TempData.clear();
-				ColumnIndex = 0;
-				RowIndex++;
-				continue;
+				Offset = NewTable->mUnescaped.size() | ArenaOffset;
+				NewTable->mUnescaped.push_back(NewTable->mArena.Store(Cell));
 			}
+			NewTable->mColumns[ColumnIndex].Offsets[RowIndex] = Offset;
+			NewTable->mColumns[ColumnIndex].Lengths[RowIndex] = static_cast<uint32_t>(Cell.size());
+		}
+
+		if (EndOfRow)
+		{
+			ColumnIndex = 0;
+			RowIndex++;
+		}
+		else
+		{
+			ColumnIndex++;
 		}
-		
-		TempData.push_back(Character);
 	}
-	NewTable->mTable[RowIndex][ColumnIndex] = TempData.data();
+
+	Reader.Seek(Reader.GetDataLength());
 	return NewTable;
 }
 
@@ -173,7 +274,7 @@ const std::string* TypedDataTable::GetColumnHeader(size_t ColumnIndex)
 
 	return nullptr;
 }
-ColumnDataType TypedDataTable::GetColumnDataType(size_t ColumnIndex)
+ColumnDataType TypedDataTable::GetColumnDataType(size_t ColumnIndex) const
 {
 	if (ColumnIndex < mColumnDataTypes.size())
 	{
@@ -182,7 +283,7 @@ ColumnDataType TypedDataTable::GetColumnDataType(size_t ColumnIndex)
 
 	return ColumnDataType::Unknown;
 }
-const std::vector<int32_t>* TypedDataTable::GetColumnInteger(size_t ColumnIndex) const
+const std::vector<int64_t>* TypedDataTable::GetColumnInteger(size_t ColumnIndex) const
 {
 	if (ColumnIndex < mColumnHeaders.size())
 	{
@@ -191,7 +292,7 @@ const std::vector<int32_t>* TypedDataTable::GetColumnInteger(size_t ColumnIndex)
 
 	return nullptr;
 }
-const std::vector<float>* TypedDataTable::GetColumnFloat(size_t ColumnIndex) const
+const std::vector<double>* TypedDataTable::GetColumnFloat(size_t ColumnIndex) const
 {
 	if (ColumnIndex < mColumnHeaders.size())
 	{
@@ -200,7 +301,7 @@ const std::vector<float>* TypedDataTable::GetColumnFloat(size_t ColumnIndex) con
 
 	return nullptr;
 }
-const std::vector<std::string>* TypedDataTable::GetColumnString(size_t ColumnIndex) const
+const TextColumn* TypedDataTable::GetColumnString(size_t ColumnIndex) const
 {
 	if (ColumnIndex < mColumnHeaders.size())
 	{
@@ -210,215 +311,429 @@ const std::vector<std::string>* TypedDataTable::GetColumnString(size_t ColumnInd
 	return nullptr;
 }
 
-const std::string*const TypedDataTable::GetCellAsString(size_t Row, size_t Column) const
+std::string_view TypedDataTable::GetCellAsString(size_t Row, size_t Column) const
 {
 	if (Column < mStringValues.size())
 	{
 		if (mStringValues[Column])
 		{
-			if (Row < mStringValues[Column]->size())
+			if (Row < mStringValues[Column]->GetNumRows())
 			{
-				return &((*mStringValues[Column])[Row]);
+				return mStringValues[Column]->Get(Row);
 			}
 		}
 	}
-	return nullptr;
+	return std::string_view();
+}
+
+bool TypedDataTable::IsCellEmpty(size_t Row, size_t Column) const
+{
+	if (Column < mEmptyCells.size() && Row < mEmptyCells[Column].size())
+	{
+		return mEmptyCells[Column][Row];
+	}
+	return true;
 }
 
 namespace {
 	template<typename T>
-	void AddToColumn(std::unique_ptr<std::vector<T>>& ColumnValues, const T& Value, size_t TotalRows, size_t RowIndex)
+	void MergeColumn(std::unique_ptr<std::vector<T>>& ColumnValues, std::unique_ptr<std::vector<T>>& ChunkValues, size_t TotalRows, size_t FirstRow, size_t NumRows)
 	{
 		if (!ColumnValues)
 		{
 			ColumnValues.reset(new std::vector<T>());
 			ColumnValues->resize(TotalRows);
-			memset(ColumnValues->data(), 0, sizeof(T)* TotalRows);
 		}
 
-		(*ColumnValues)[RowIndex] = Value;
+		std::move(ChunkValues->begin(), ChunkValues->begin() + NumRows, ColumnValues->begin() + FirstRow);
+		ChunkValues.reset();
 	}
 
-	void AddToColumn(std::unique_ptr<std::vector<std::string>>& ColumnValues, const std::string& Value, size_t TotalRows, size_t RowIndex)
+	// Offsets of the chunks the input is parsed in, plus the end of the input. Each chunk after the
+	// first starts on a row: the quotes in the chunks before a nominal split say whether it falls
+	// inside a quoted field, and the split moves forward to the next newline outside quotes.
+	std::vector<size_t> SplitCSVChunks(const uint8_t* Data, size_t Length, size_t MaxThreads)
 	{
-		if (!ColumnValues)
+		constexpr size_t MinChunkSize = 1 << 20;
+
+		size_t NumChunks = MaxThreads > 0 ? MaxThreads : std::max<size_t>(std::thread::hardware_concurrency(), 1);
+		NumChunks = std::clamp<size_t>(Length / MinChunkSize, 1, NumChunks);
+
+		std::vector<size_t> Splits(NumChunks + 1);
+		for (size_t Chunk = 0; Chunk <= NumChunks; ++Chunk)
 		{
-			ColumnValues.reset(new std::vector<std::string>());
-			ColumnValues->resize(TotalRows);
+			Splits[Chunk] = Length / NumChunks * Chunk;
 		}
+		Splits[NumChunks] = Length;
+
+		std::vector<size_t> Quotes(NumChunks, 0);
+		RunChunks(NumChunks, nullptr, [&](size_t Chunk)
+		{
+			Quotes[Chunk] = CSVScanner::CountQuotes(Data + Splits[Chunk], Splits[Chunk + 1] - Splits[Chunk]);
+		});
 
-		(*ColumnValues)[RowIndex] = Value;
+		std::vector<size_t> ChunkStarts = { 0 };
+		size_t QuotesBefore = 0;
+		for (size_t Chunk = 1; Chunk < NumChunks; ++Chunk)
+		{
+			QuotesBefore += Quotes[Chunk - 1];
+			if (ChunkStarts.back() >= Splits[Chunk])
+			{
+				// the row found for the previous split runs past this one
+				continue;
+			}
+			const size_t Start = CSVScanner::FindRowStart(Data, Length, Splits[Chunk], (QuotesBefore & 1) != 0);
+			if (Start >= Length)
+			{
+				break;
+			}
+			ChunkStarts.push_back(Start);
+		}
+		ChunkStarts.push_back(Length);
+		return ChunkStarts;
 	}
 }
 
-TypedDataTablePtr TypedDataTable::CreateFromCSV(BinaryReader& Reader, uint32_t RowDataStarts, uint32_t RowForColumns, ProgressReporter ReportProgress)
+TypedDataTablePtr TypedDataTable::CreateFromCSV(BinaryReader& Reader, uint32_t RowDataStarts, uint32_t RowForColumns, ProgressReporter ReportProgress, size_t MaxThreads, size_t NumColumns, char Delimiter)
 {
-	constexpr char CarriageReturn = '\n';
-	constexpr char Comma = ',';
-	constexpr char DoubleQuote = '\"';
-
-	size_t StartOfBuffer = Reader.GetReadPosition();
-	size_t NumColumns = 0;
-	size_t NumRows = 0;
-	size_t MaxLengthRow = 0;
-	size_t CurrentLengthRow = 0;
-	char Character = (char)Reader.ReadUInt8();
-
-	NumRows++;
-	NumColumns++;
-	while (Character != CarriageReturn && Character != DoubleQuote && Reader.GetReadPosition() < Reader.GetDataLength())
-	{
-		CurrentLengthRow++;
-		if (Character == Comma)
-		{
-			MaxLengthRow = std::max(CurrentLengthRow, MaxLengthRow);
-			CurrentLengthRow = 0;
-			NumColumns++;
-		}
-		Character = (char)Reader.ReadUInt8();
+	const uint8_t* Data = Reader.GetRemainingData();
+	const size_t Length = Reader.GetRemainingLength();
+	if (NumColumns == 0)
+	{
+		NumColumns = CountCSVColumns(Data, Length, Delimiter);
 	}
-	NumRows++;
-	while (Reader.GetReadPosition() < Reader.GetDataLength())
+	const std::vector<size_t> ChunkStarts = SplitCSVChunks(Data, Length, MaxThreads);
+	const size_t NumChunks = ChunkStarts.size() - 1;
+
+	// every chunk but the last ends on a newline; the last also holds the row after the final newline
+	std::vector<size_t> ChunkFirstRows(NumChunks + 1, 0);
+	RunChunks(NumChunks, nullptr, [&](size_t Chunk)
 	{
-		Character = (char)Reader.ReadUInt8();
-		CurrentLengthRow++;
+		ChunkFirstRows[Chunk + 1] = CSVScanner::CountLines(Data + ChunkStarts[Chunk], ChunkStarts[Chunk + 1] - ChunkStarts[Chunk]);
+	});
+	ChunkFirstRows[NumChunks]++;
+	for (size_t Chunk = 0; Chunk < NumChunks; ++Chunk)
+	{
+		ChunkFirstRows[Chunk + 1] += ChunkFirstRows[Chunk];
+	}
+	const size_t NumRows = ChunkFirstRows[NumChunks];
 
-		if (Character == CarriageReturn)
+	std::vector<TypedDataTablePtr> ChunkTables(NumChunks);
+	std::atomic<size_t> RowsParsed = 0;
+	std::function<void()> ReportRows;
+	if (ReportProgress)
+	{
+		ReportRows = [&]()
 		{
-			NumRows++;
-			MaxLengthRow = std::max(CurrentLengthRow, MaxLengthRow);
-			CurrentLengthRow = 0;
-		}
+			ReportProgress(static_cast<float>(static_cast<double>(RowsParsed.load()) / static_cast<double>(NumRows)));
+		};
+	}
+	RunChunks(NumChunks, ReportRows, [&](size_t Chunk)
+	{
+		TypedDataTablePtr ChunkTable = std::make_shared<TypedDataTable>();
+		ChunkTable->SetSize(ChunkFirstRows[Chunk + 1] - ChunkFirstRows[Chunk], NumColumns);
+		ChunkTable->ParseCSVChunk(Data + ChunkStarts[Chunk], ChunkStarts[Chunk + 1] - ChunkStarts[Chunk], Delimiter, ChunkFirstRows[Chunk], RowDataStarts, RowForColumns, RowsParsed);
+		ChunkTables[Chunk] = std::move(ChunkTable);
+	});
+	if (ReportRows)
+	{
+		ReportRows();
 	}
 
+	// A column takes the widest type any chunk saw. Chunks that stored it as numbers no longer hold
+	// its text, so the cells of a column that ended up as text are read again from the file.
 	TypedDataTablePtr NewTable = std::make_shared<TypedDataTable>();
-	NewTable->mNumRows = NumRows;
-	NewTable->mColumnHeaders.resize(NumColumns);
-	NewTable->mColumnDataTypes.resize(NumColumns);
-	NewTable->mIntegerValues.resize(NumColumns);
-	NewTable->mFloatValues.resize(NumColumns);
-	NewTable->mStringValues.resize(NumColumns);
-
-	Reader.Seek(StartOfBuffer);
-
-	bool CaptureWholeStream = false;
-	size_t RowIndex = 0;
-	size_t ColumnIndex = 0;
-	std::string TempData;
-	TempData.reserve(MaxLengthRow);
-	while (Reader.GetReadPosition() < Reader.GetDataLength())
+	NewTable->SetSize(NumRows, NumColumns);
+	for (const auto& ChunkTable : ChunkTables)
 	{
-		Character = (char)Reader.ReadUInt8();
-		if (Character == DoubleQuote)
+		for (size_t Column = 0; Column < NumColumns; ++Column)
 		{
-			CaptureWholeStream = !CaptureWholeStream;
+			NewTable->mColumnDataTypes[Column] = std::max(NewTable->mColumnDataTypes[Column], ChunkTable->mColumnDataTypes[Column]);
 		}
-		if (!CaptureWholeStream && (Character == Comma || Character == CarriageReturn))
+	}
+	RunChunks(NumChunks, nullptr, [&](size_t Chunk)
+	{
+		auto& ChunkTable = *ChunkTables[Chunk];
+		bool Reread = false;
+		for (size_t Column = 0; Column < NumColumns; ++Column)
 		{
-			if (RowIndex >= RowDataStarts)
+			const ColumnDataType ChunkType = ChunkTable.mColumnDataTypes[Column];
+			if (NewTable->mColumnDataTypes[Column] == ColumnDataType::Text && ChunkType != ColumnDataType::Text && ChunkType != ColumnDataType::Unknown)
 			{
-				NewTable->SerialiseCell(TempData, ColumnIndex, RowIndex - RowDataStarts);
+				ChunkTable.PromoteToText(Column);
 			}
-			else if (RowIndex == RowForColumns)
+			else if (NewTable->mColumnDataTypes[Column] == ColumnDataType::Real && ChunkType == ColumnDataType::Integer)
 			{
-				NewTable->mColumnHeaders[ColumnIndex] = TempData;
+				ChunkTable.PromoteToReal(Column);
 			}
-			TempData.clear();
+			Reread = Reread || ChunkTable.mRereadText[Column];
+		}
+		if (Reread)
+		{
+			ChunkTable.RereadText(Data + ChunkStarts[Chunk], ChunkStarts[Chunk + 1] - ChunkStarts[Chunk], Delimiter, ChunkFirstRows[Chunk], RowDataStarts);
+		}
+	});
 
-			if (Character == Comma)
-			{
-				ColumnIndex++;
-			}
-			else if (Character == CarriageReturn)
+	// chunk tables are indexed from their first data row, so merging them in order is a copy per
+	// column; text cells are views, so only the chunk arenas they point into change hands
+	for (size_t Chunk = 0; Chunk < NumChunks; ++Chunk)
+	{
+		auto& ChunkTable = *ChunkTables[Chunk];
+		NewTable->mArena.Adopt(ChunkTable.mArena);
+		const size_t FirstRow = ChunkFirstRows[Chunk];
+		const size_t EndRow = ChunkFirstRows[Chunk + 1];
+		if (RowForColumns >= FirstRow && RowForColumns < EndRow)
+		{
+			NewTable->mColumnHeaders = std::move(ChunkTable.mColumnHeaders);
+		}
+
+		const size_t FirstDataRow = std::max<size_t>(FirstRow, RowDataStarts);
+		if (FirstDataRow >= EndRow)
+		{
+			continue;
+		}
+		const size_t MergedRow = FirstDataRow - RowDataStarts;
+		const size_t MergedRows = EndRow - FirstDataRow;
+		for (size_t Column = 0; Column < NumColumns; ++Column)
+		{
+			switch (ChunkTable.mColumnDataTypes[Column])
 			{
-				ColumnIndex = 0;
-				RowIndex++;
-				if (ReportProgress)
-				{
-					ReportProgress(static_cast<float>(static_cast<double>(RowIndex) / static_cast<double>(NumRows)));
-				}
+			case ColumnDataType::Integer:
+				MergeColumn(NewTable->mIntegerValues[Column], ChunkTable.mIntegerValues[Column], NumRows, MergedRow, MergedRows);
+				break;
+			case ColumnDataType::Real:
+				MergeColumn(NewTable->mFloatValues[Column], ChunkTable.mFloatValues[Column], NumRows, MergedRow, MergedRows);
+				break;
+			case ColumnDataType::Text:
+				// re-coded into the merged column's dictionary; the text stays in the adopted arenas
+				NewTable->AllocateColumn(NewTable->mStringValues[Column]);
+				NewTable->mStringValues[Column]->CopyRows(*ChunkTable.mStringValues[Column], MergedRow, MergedRows);
+				ChunkTable.mStringValues[Column].reset();
+				break;
+			default:
+				// every cell of this column in the chunk was empty
+				continue;
 			}
+			const auto& ChunkEmpty = ChunkTable.mEmptyCells[Column];
+			std::copy(ChunkEmpty.begin(), ChunkEmpty.begin() + MergedRows, NewTable->mEmptyCells[Column].begin() + MergedRow);
 		}
-		else
+		ChunkTables[Chunk].reset();
+	}
+
+	// a column whose chunks were all empty still needs its one vector for the type it was given
+	for (size_t Column = 0; Column < NumColumns; ++Column)
+	{
+		switch (NewTable->mColumnDataTypes[Column])
 		{
-			TempData.push_back(Character);
+		case ColumnDataType::Integer:
+			NewTable->AllocateColumn(NewTable->mIntegerValues[Column]);
+			break;
+		case ColumnDataType::Real:
+			NewTable->AllocateColumn(NewTable->mFloatValues[Column]);
+			break;
+		case ColumnDataType::Text:
+			NewTable->AllocateColumn(NewTable->mStringValues[Column]);
+			break;
+		default:
+			break;
 		}
 	}
 
-	NewTable->SerialiseCell(TempData, ColumnIndex, RowIndex);
+	Reader.Seek(Reader.GetDataLength());
+	return NewTable;
+}
+
+void TypedDataTable::SetSize(size_t NumRows, size_t NumColumns)
+{
+	mNumRows = NumRows;
+	mColumnHeaders.resize(NumColumns);
+	mColumnDataTypes.assign(NumColumns, ColumnDataType::Unknown);
+	mIntegerValues.resize(NumColumns);
+	mFloatValues.resize(NumColumns);
+	mStringValues.resize(NumColumns);
+	mEmptyCells.assign(NumColumns, std::vector<bool>(NumRows, true));
+	mRereadText.assign(NumColumns, false);
+}
+
+void TypedDataTable::ParseCSVChunk(const uint8_t* Data, size_t Length, char Delimiter, size_t FirstRow, uint32_t RowDataStarts, uint32_t RowForColumns, std::atomic<size_t>& RowsParsed)
+{
+	constexpr size_t ProgressInterval = 4096;
 
-		
-	for (auto Column = 0; Column < NumColumns; ++Column)
+	const size_t FirstDataRow = std::max<size_t>(FirstRow, RowDataStarts);
+	const size_t NumColumns = mColumnHeaders.size();
+	CSVScanner Scanner(Data, Length, Delimiter);
+	size_t RowIndex = FirstRow;
+	size_t ColumnIndex = 0;
+	size_t UnreportedRows = 0;
+	std::string_view Field;
+	bool EndOfRow = false;
+	while (Scanner.NextField(Field, EndOfRow))
 	{
-		auto& FloatValues = NewTable->mFloatValues[Column];
-		auto& IntegerValues = NewTable->mIntegerValues[Column];
-		if (IntegerValues && FloatValues)
+		if (ColumnIndex < NumColumns)
 		{
-			for (auto ValueIndex = 0; ValueIndex < IntegerValues->size(); ++ValueIndex)
+			if (RowIndex >= RowDataStarts)
+			{
+				SerialiseCell(Field, ColumnIndex, RowIndex - FirstDataRow);
+			}
+			else if (RowIndex == RowForColumns)
 			{
-				(*FloatValues)[ValueIndex] = (*FloatValues)[ValueIndex] == 0.0f ? (float)(*IntegerValues)[ValueIndex] : (*FloatValues)[ValueIndex];
+				mColumnHeaders[ColumnIndex].assign(Field.data(), Field.size());
 			}
-			IntegerValues.reset();
 		}
-	}
-
-	for (auto ColumnIndex = 0; ColumnIndex < NumColumns; ++ColumnIndex)
-	{
-		const auto& FloatValues = NewTable->mFloatValues[ColumnIndex];
-		const auto& StringValues = NewTable->mStringValues[ColumnIndex];
-		const auto& IntValues = NewTable->mIntegerValues[ColumnIndex];
 
-		int DataTypeMask = static_cast<int>(ColumnDataType::Unknown);
-		if (FloatValues)
+		if (EndOfRow)
 		{
-			DataTypeMask |= static_cast<int>(ColumnDataType::Real);
+			ColumnIndex = 0;
+			RowIndex++;
+			if (++UnreportedRows == ProgressInterval)
+			{
+				RowsParsed.fetch_add(UnreportedRows, std::memory_order_relaxed);
+				UnreportedRows = 0;
+			}
 		}
-		if (IntValues)
+		else
 		{
-			DataTypeMask |= static_cast<int>(ColumnDataType::Integer);
+			ColumnIndex++;
 		}
+	}
+	RowsParsed.fetch_add(UnreportedRows, std::memory_order_relaxed);
+}
 
-		if (StringValues && DataTypeMask == static_cast<int>(ColumnDataType::Unknown))
+void TypedDataTable::RereadText(const uint8_t* Data, size_t Length, char Delimiter, size_t FirstRow, uint32_t RowDataStarts)
+{
+	const size_t FirstDataRow = std::max<size_t>(FirstRow, RowDataStarts);
+	const size_t NumColumns = mColumnHeaders.size();
+	CSVScanner Scanner(Data, Length, Delimiter);
+	size_t RowIndex = FirstRow;
+	size_t ColumnIndex = 0;
+	std::string_view Field;
+	bool EndOfRow = false;
+	while (Scanner.NextField(Field, EndOfRow))
+	{
+		// empty cells were never stored, which also skips the empty field after a chunk's last newline
+		if (ColumnIndex < NumColumns && RowIndex >= RowDataStarts && mRereadText[ColumnIndex] && !Field.empty())
 		{
-			DataTypeMask = static_cast<int>(ColumnDataType::Text);
+			mStringValues[ColumnIndex]->Set(RowIndex - FirstDataRow, Field, &mArena);
 		}
 
-		NewTable->mColumnDataTypes[ColumnIndex] = static_cast<ColumnDataType>(DataTypeMask);
-		
+		if (EndOfRow)
+		{
+			ColumnIndex = 0;
+			RowIndex++;
+		}
+		else
+		{
+			ColumnIndex++;
+		}
 	}
+	mRereadText.assign(NumColumns, false);
+}
 
+bool TypedDataTable::ParseInteger(std::string_view Text, int64_t& OutValue)
+{
+	Text = NumberText(Text);
+	const auto Result = std::from_chars(Text.data(), Text.data() + Text.size(), OutValue);
+	return !Text.empty() && Result.ec == std::errc() && Result.ptr == Text.data() + Text.size();
+}
 
-	return NewTable;
+bool TypedDataTable::ParseReal(std::string_view Text, double& OutValue)
+{
+	Text = NumberText(Text);
+	const auto Result = std::from_chars(Text.data(), Text.data() + Text.size(), OutValue);
+	return !Text.empty() && Result.ec == std::errc() && Result.ptr == Text.data() + Text.size();
 }
 
-void TypedDataTable::SerialiseCell(const std::string& TempData, size_t ColumnIndex, size_t RowIndex)
+void TypedDataTable::SerialiseCell(std::string_view Text, size_t ColumnIndex, size_t RowIndex)
 {
-	if (TempData.length() > 0)
+	if (Text.empty())
 	{
-		try {
+		return;
+	}
+	mEmptyCells[ColumnIndex][RowIndex] = false;
 
-			size_t CharactersProcessed = 0;
-			int32_t IntegerResult = std::stoi(TempData, &CharactersProcessed);
-			if (CharactersProcessed == TempData.length())
-			{
-				AddToColumn(mIntegerValues[ColumnIndex], IntegerResult, mNumRows, RowIndex);
-			}
-			else
-			{
-				// we are floats
-				size_t FloatCharactersProcessed = 0;
-				float FloatResult = std::stof(TempData, &FloatCharactersProcessed);
-				if (FloatCharactersProcessed == TempData.length())
-				{
-					AddToColumn(mFloatValues[ColumnIndex], FloatResult, mNumRows, RowIndex);
-				}
-			}
+	int64_t IntegerResult = 0;
+	double RealResult = 0.0;
+	switch (mColumnDataTypes[ColumnIndex])
+	{
+	case ColumnDataType::Unknown:
+		if (ParseInteger(Text, IntegerResult))
+		{
+			mColumnDataTypes[ColumnIndex] = ColumnDataType::Integer;
+			AllocateColumn(mIntegerValues[ColumnIndex]);
+			(*mIntegerValues[ColumnIndex])[RowIndex] = IntegerResult;
 		}
-		catch (const std::exception&)
+		else if (ParseReal(Text, RealResult))
 		{
-
+			mColumnDataTypes[ColumnIndex] = ColumnDataType::Real;
+			AllocateColumn(mFloatValues[ColumnIndex]);
+			(*mFloatValues[ColumnIndex])[RowIndex] = RealResult;
 		}
-		AddToColumn(mStringValues[ColumnIndex], TempData, mNumRows, RowIndex);
+		else
+		{
+			mColumnDataTypes[ColumnIndex] = ColumnDataType::Text;
+			AllocateColumn(mStringValues[ColumnIndex]);
+			mStringValues[ColumnIndex]->Set(RowIndex, Text, &mArena);
+		}
+		break;
+	case ColumnDataType::Integer:
+		if (ParseInteger(Text, IntegerResult))
+		{
+			(*mIntegerValues[ColumnIndex])[RowIndex] = IntegerResult;
+			break;
+		}
+		PromoteToReal(ColumnIndex);
+		// stored as a real, or as text if it isn't a number at all
+		[[fallthrough]];
+	case ColumnDataType::Real:
+		if (ParseReal(Text, RealResult))
+		{
+			(*mFloatValues[ColumnIndex])[RowIndex] = RealResult;
+			break;
+		}
+		PromoteToText(ColumnIndex);
+		[[fallthrough]];
+	case ColumnDataType::Text:
+		mStringValues[ColumnIndex]->Set(RowIndex, Text, &mArena);
+		break;
+	}
+}
+
+template<typename T>
+void TypedDataTable::AllocateColumn(std::unique_ptr<std::vector<T>>& ColumnValues)
+{
+	if (!ColumnValues)
+	{
+		ColumnValues.reset(new std::vector<T>(mNumRows));
+	}
+}
+
+void TypedDataTable::AllocateColumn(std::unique_ptr<TextColumn>& ColumnValues)
+{
+	if (!ColumnValues)
+	{
+		ColumnValues.reset(new TextColumn());
+		ColumnValues->Resize(mNumRows);
+	}
+}
+
+void TypedDataTable::PromoteToReal(size_t ColumnIndex)
+{
+	AllocateColumn(mFloatValues[ColumnIndex]);
+	if (auto& IntegerValues = mIntegerValues[ColumnIndex])
+	{
+		std::copy(IntegerValues->begin(), IntegerValues->end(), mFloatValues[ColumnIndex]->begin());
+		IntegerValues.reset();
 	}
+	mColumnDataTypes[ColumnIndex] = ColumnDataType::Real;
+}
 
-}
\ No newline at end of file
+void TypedDataTable::PromoteToText(size_t ColumnIndex)
+{
+	// the numbers already stored can't be turned back into the exact text they came from
+	// (leading zeros, trailing decimal zeros), so that text is read again once the chunk is done
+	mIntegerValues[ColumnIndex].reset();
+	mFloatValues[ColumnIndex].reset();
+	AllocateColumn(mStringValues[ColumnIndex]);
+	mRereadText[ColumnIndex] = true;
+	mColumnDataTypes[ColumnIndex] = ColumnDataType::Text;
+}
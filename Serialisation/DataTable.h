@@ -1,15 +1,22 @@
 #pragma once
 
+#include "Arena.h"
+#include "TextColumn.h"
+#include <atomic>
 #include <memory>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <functional>
+#include <stdint.h>
 
 class BinaryReader;
 class DataTable;
+class ColumnarDataTable;
 class TypedDataTable;
 
 using DataTablePtr = std::shared_ptr<DataTable>;
+using ColumnarDataTablePtr = std::shared_ptr<ColumnarDataTable>;
 using TypedDataTablePtr = std::shared_ptr<TypedDataTable>;
 
 class DataTable 
@@ -18,7 +25,7 @@ public:
 
 	explicit DataTable();
 
-	const std::string*const GetCell(size_t Row, size_t Column) const;
+	const std::string* GetCell(size_t Row, size_t Column) const;
 	size_t GetNumColumns() const { return GetNumRows() > 0 ? mTable[0].size() : 0; }
 	size_t GetNumRows() const { return mTable.size(); }
 
@@ -36,6 +43,47 @@ private:
 		
 };
 
+// DataTable laid out by column, where each cell is an offset and length into the buffer it was
+// parsed from rather than a string of its own: loading is one pass recording where the fields
+// are. Quoted fields are returned without their quotes, and only those with doubled quotes to
+// unescape are copied, into the table's arena. The buffer must outlive the table.
+// A standalone building block: no load path uses it yet, as imports, csvmap and the UI all go
+// through TypedDataTable.
+class ColumnarDataTable
+{
+public:
+
+	size_t GetNumColumns() const { return mColumns.size(); }
+	size_t GetNumRows() const { return mNumRows; }
+
+	// empty for cells past the end of a short row
+	std::string_view GetCell(size_t Row, size_t Column) const;
+
+	// the cell index and the arena; the cells themselves stay in the source buffer
+	size_t GetMemoryUsage() const;
+	size_t GetArenaSize() const { return mArena.GetStats().BytesReserved; }
+
+	static ColumnarDataTablePtr CreateFromCSV(BinaryReader& Reader);
+
+private:
+
+	// offsets with this bit set index mUnescaped instead of the source
+	static constexpr uint64_t ArenaOffset = uint64_t(1) << 63;
+
+	struct Column
+	{
+		std::vector<uint64_t> Offsets;
+		std::vector<uint32_t> Lengths;
+	};
+
+	const char* mSource = nullptr;
+	// unescaped cells, which live in mArena
+	std::vector<std::string_view> mUnescaped;
+	Arena mArena;
+	std::vector<Column> mColumns;
+	size_t mNumRows = 0;
+};
+
 using ProgressReporter = std::function<void(float)>;
 
 enum class ColumnDataType
@@ -80,25 +128,54 @@ public:
 
 	const std::vector<ColumnDataType>& GetColumnDataTypes() { return mColumnDataTypes; }
 	const std::string* GetColumnHeader(size_t ColumnIndex);
-	ColumnDataType GetColumnDataType(size_t ColumnIndex);
+	ColumnDataType GetColumnDataType(size_t ColumnIndex) const;
 	
-	const std::vector<int32_t>* GetColumnInteger(size_t ColumnIndex) const;
-	const std::vector<float>* GetColumnFloat(size_t ColumnIndex) const;
-	const std::vector<std::string>* GetColumnString(size_t ColumnIndex) const;
+	const std::vector<int64_t>* GetColumnInteger(size_t ColumnIndex) const;
+	const std::vector<double>* GetColumnFloat(size_t ColumnIndex) const;
+	// Text columns are dictionary-encoded while they have few distinct values; see TextColumn.
+	// Cells are views into the table's arena and stay valid for the table's lifetime.
+	const TextColumn* GetColumnString(size_t ColumnIndex) const;
+
+	// only text columns hold strings; numeric columns read back empty here
+	std::string_view GetCellAsString(size_t Row, size_t Column) const;
+	const Arena::Stats& GetArenaStats() const { return mArena.GetStats(); }
+	bool IsCellEmpty(size_t Row, size_t Column) const;
 
-	const std::string*const GetCellAsString(size_t Row, size_t Column) const;
 
+	// The input is split into one chunk per core (or MaxThreads, when set), each starting on a row,
+	// parsed concurrently into per-chunk columns and merged in order. NumColumns is taken from the
+	// first record unless given, which lets a caller parse a slice of rows from the middle of a file.
+	// Delimiter is what CSVSniffer found for files that aren't comma-separated.
+	static TypedDataTablePtr CreateFromCSV(BinaryReader& Reader, uint32_t RowDataStarts, uint32_t RowForColumns, ProgressReporter ReportProgress, size_t MaxThreads = 0, size_t NumColumns = 0, char Delimiter = ',');
 
-	static TypedDataTablePtr CreateFromCSV(BinaryReader& Reader, uint32_t RowDataStarts, uint32_t RowForColumns, ProgressReporter ReportProgress);
+	// the rules cells are typed by: leading whitespace and a '+' are allowed, trailing text is not
+	static bool ParseInteger(std::string_view Text, int64_t& OutValue);
+	static bool ParseReal(std::string_view Text, double& OutValue);
 
 private:
 
-	void SerialiseCell(const std::string& Data, size_t Column, size_t Row);
+	void SetSize(size_t NumRows, size_t NumColumns);
+	void ParseCSVChunk(const uint8_t* Data, size_t Length, char Delimiter, size_t FirstRow, uint32_t RowDataStarts, uint32_t RowForColumns, std::atomic<size_t>& RowsParsed);
+	void RereadText(const uint8_t* Data, size_t Length, char Delimiter, size_t FirstRow, uint32_t RowDataStarts);
+	void SerialiseCell(std::string_view Data, size_t Column, size_t Row);
+
+	template<typename T>
+	void AllocateColumn(std::unique_ptr<std::vector<T>>& ColumnValues);
+	void AllocateColumn(std::unique_ptr<TextColumn>& ColumnValues);
+	void PromoteToReal(size_t Column);
+	void PromoteToText(size_t Column);
 
 	std::vector<std::string> mColumnHeaders;
+	// Each column is stored once, in the vector for its type: it starts as whatever its first cell
+	// parses as and is promoted integer -> real -> text when a later cell doesn't fit.
 	std::vector<ColumnDataType> mColumnDataTypes;
-	std::vector<std::unique_ptr<std::vector<int32_t>>> mIntegerValues;
-	std::vector<std::unique_ptr<std::vector<float>>> mFloatValues;
-	std::vector<std::unique_ptr<std::vector<std::string>>> mStringValues;
+	std::vector<std::unique_ptr<std::vector<int64_t>>> mIntegerValues;
+	std::vector<std::unique_ptr<std::vector<double>>> mFloatValues;
+	std::vector<std::unique_ptr<TextColumn>> mStringValues;
+	std::vector<std::vector<bool>> mEmptyCells;
+	// columns promoted to text whose earlier cells must be read again from the file
+	std::vector<bool> mRereadText;
 	size_t mNumRows;
+	// holds the text cells; chunk tables hand theirs over when they are merged
+	Arena mArena;
 };
@@ -0,0 +1,120 @@
+#include "MappedFile.h"
+#include <stdio.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFilePtr MappedFile::Open(const std::string& FilePath)
+{
+	const HANDLE File = CreateFileA(FilePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (File == INVALID_HANDLE_VALUE)
+	{
+		fprintf(stderr, "Failed to open %s: error %lu\n", FilePath.c_str(), GetLastError());
+		return nullptr;
+	}
+
+	MappedFilePtr Mapped(new MappedFile());
+	Mapped->mFile = File;
+
+	LARGE_INTEGER FileSize;
+	if (!GetFileSizeEx(File, &FileSize))
+	{
+		fprintf(stderr, "Failed to size %s: error %lu\n", FilePath.c_str(), GetLastError());
+		return nullptr;
+	}
+
+	// mapping an empty file fails, and there is nothing to read anyway
+	if (FileSize.QuadPart == 0)
+	{
+		return Mapped;
+	}
+
+	Mapped->mMapping = CreateFileMappingA(File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	const void* View = Mapped->mMapping ? MapViewOfFile(Mapped->mMapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	if (!View)
+	{
+		fprintf(stderr, "Failed to map %s: error %lu\n", FilePath.c_str(), GetLastError());
+		return nullptr;
+	}
+
+	Mapped->mData = static_cast<const uint8_t*>(View);
+	Mapped->mSize = static_cast<size_t>(FileSize.QuadPart);
+	return Mapped;
+}
+
+MappedFile::~MappedFile()
+{
+	if (mData)
+	{
+		UnmapViewOfFile(mData);
+	}
+	if (mMapping)
+	{
+		CloseHandle(mMapping);
+	}
+	if (mFile)
+	{
+		CloseHandle(mFile);
+	}
+}
+
+#else
+
+MappedFilePtr MappedFile::Open(const std::string& FilePath)
+{
+	const int File = open(FilePath.c_str(), O_RDONLY);
+	if (File < 0)
+	{
+		perror(FilePath.c_str());
+		return nullptr;
+	}
+
+	MappedFilePtr Mapped(new MappedFile());
+	struct stat Status;
+	if (fstat(File, &Status) != 0)
+	{
+		perror(FilePath.c_str());
+		close(File);
+		return nullptr;
+	}
+
+	// mapping an empty file fails, and there is nothing to read anyway
+	if (Status.st_size > 0)
+	{
+		void* View = mmap(nullptr, static_cast<size_t>(Status.st_size), PROT_READ, MAP_PRIVATE, File, 0);
+		if (View == MAP_FAILED)
+		{
+			perror(FilePath.c_str());
+			close(File);
+			return nullptr;
+		}
+		posix_madvise(View, static_cast<size_t>(Status.st_size), POSIX_MADV_SEQUENTIAL);
+
+		Mapped->mData = static_cast<const uint8_t*>(View);
+		Mapped->mSize = static_cast<size_t>(Status.st_size);
+	}
+
+	// the mapping keeps the file referenced on its own
+	close(File);
+	return Mapped;
+}
+
+MappedFile::~MappedFile()
+{
+	if (mData)
+	{
+		munmap(const_cast<uint8_t*>(mData), mSize);
+	}
+}
+
+#endif
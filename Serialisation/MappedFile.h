@@ -0,0 +1,41 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <stdint.h>
+#include <stddef.h>
+
+class MappedFile;
+using MappedFilePtr = std::unique_ptr<MappedFile>;
+
+// A whole file mapped read-only into memory. The OS is told it will be read front to back, so
+// pages are read ahead and dropped behind; nothing is copied into the process heap.
+class MappedFile final
+{
+public:
+
+	// returns nullptr if the file can't be opened or mapped
+	static MappedFilePtr Open(const std::string& FilePath);
+
+	~MappedFile();
+
+	MappedFile(const MappedFile& copy) = delete;
+	MappedFile(const MappedFile&& Rhs) = delete;
+	MappedFile& operator=(const MappedFile& Rhs) = delete;
+	MappedFile& operator=(const MappedFile&& Rhs) = delete;
+
+	// nullptr for an empty file
+	const uint8_t* GetData() const { return mData; }
+	size_t GetSize() const { return mSize; }
+
+private:
+
+	MappedFile() = default;
+
+	const uint8_t* mData = nullptr;
+	size_t mSize = 0;
+#ifdef _WIN32
+	void* mFile = nullptr;
+	void* mMapping = nullptr;
+#endif
+};
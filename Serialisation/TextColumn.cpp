@@ -0,0 +1,205 @@
+#include "TextColumn.h"
+#include <algorithm>
+#include <limits>
+
+namespace
+{
+	// a dictionary this small is always worth keeping, whatever the row count
+	constexpr size_t AlwaysEncodedValues = 256;
+	// rows seen before the distinct-value ratio is trusted
+	constexpr size_t MinRowsToJudge = 4096;
+	constexpr size_t RowsPerValue = 8;
+}
+
+void TextColumn::Resize(size_t NumRows)
+{
+	mNumRows = NumRows;
+	switch (mCodeBits)
+	{
+	case 8:
+		mCodes8.resize(NumRows, 0);
+		break;
+	case 16:
+		mCodes16.resize(NumRows, 0);
+		break;
+	case 32:
+		mCodes32.resize(NumRows, 0);
+		break;
+	default:
+		mPlain.resize(NumRows, std::string_view("", 0));
+		break;
+	}
+}
+
+void TextColumn::Set(size_t Row, std::string_view Text, Arena* Storage)
+{
+	mRowsSeen = std::max(mRowsSeen, Row + 1);
+	uint32_t Code = 0;
+	if (IsEncoded() && Intern(Text, Storage, Code))
+	{
+		SetCode(Row, Code);
+		return;
+	}
+
+	if (Storage)
+	{
+		mPlain[Row] = Storage->Store(Text);
+	}
+	else
+	{
+		mPlain[Row] = Text.empty() ? std::string_view("", 0) : Text;
+	}
+}
+
+void TextColumn::Append(std::string_view Text, Arena* Storage)
+{
+	Resize(mNumRows + 1);
+	Set(mNumRows - 1, Text, Storage);
+}
+
+std::string_view TextColumn::Get(size_t Row) const
+{
+	return IsEncoded() ? mValues[GetCode(Row)] : mPlain[Row];
+}
+
+void TextColumn::CopyRows(const TextColumn& Source, size_t FirstRow, size_t NumRows)
+{
+	size_t Row = 0;
+	if (Source.IsEncoded())
+	{
+		// each of Source's values is looked up once, however many rows carry it
+		constexpr uint32_t Unmapped = std::numeric_limits<uint32_t>::max();
+		std::vector<uint32_t> Translated(Source.GetCardinality(), Unmapped);
+		Translated[0] = 0;
+		for (; Row < NumRows && IsEncoded(); ++Row)
+		{
+			mRowsSeen = std::max(mRowsSeen, FirstRow + Row + 1);
+			const uint32_t SourceCode = Source.GetCode(Row);
+			uint32_t& Code = Translated[SourceCode];
+			if (Code == Unmapped && !Intern(Source.mValues[SourceCode], nullptr, Code))
+			{
+				// the column just switched to plain views; this row is copied with the rest below
+				break;
+			}
+			SetCode(FirstRow + Row, Code);
+		}
+	}
+	else
+	{
+		for (; Row < NumRows && IsEncoded(); ++Row)
+		{
+			Set(FirstRow + Row, Source.mPlain[Row], nullptr);
+		}
+	}
+
+	// once this column holds plain views, whatever is left is a straight copy
+	for (; Row < NumRows; ++Row)
+	{
+		mPlain[FirstRow + Row] = Source.Get(Row);
+	}
+	mRowsSeen = std::max(mRowsSeen, FirstRow + NumRows);
+}
+
+uint32_t TextColumn::GetCode(size_t Row) const
+{
+	switch (mCodeBits)
+	{
+	case 8:
+		return mCodes8[Row];
+	case 16:
+		return mCodes16[Row];
+	default:
+		return mCodes32[Row];
+	}
+}
+
+size_t TextColumn::GetMemoryUsage() const
+{
+	// an unordered_map node holds the key, the code and a next pointer, plus a bucket slot
+	constexpr size_t LookupEntryBytes = sizeof(std::string_view) + 2 * sizeof(void*) + sizeof(uint32_t);
+
+	return mCodes8.capacity() * sizeof(uint8_t) + mCodes16.capacity() * sizeof(uint16_t) + mCodes32.capacity() * sizeof(uint32_t)
+		+ mValues.capacity() * sizeof(std::string_view) + mLookup.size() * LookupEntryBytes + mLookup.bucket_count() * sizeof(void*)
+		+ mPlain.capacity() * sizeof(std::string_view);
+}
+
+bool TextColumn::Intern(std::string_view Text, Arena* Storage, uint32_t& OutCode)
+{
+	if (Text.empty())
+	{
+		OutCode = 0;
+		return true;
+	}
+
+	const auto Found = mLookup.find(Text);
+	if (Found != mLookup.end())
+	{
+		OutCode = Found->second;
+		return true;
+	}
+
+	const size_t Values = mValues.size() + 1;
+	if (Values > AlwaysEncodedValues && Values * RowsPerValue > std::max(mRowsSeen, MinRowsToJudge))
+	{
+		Decode();
+		return false;
+	}
+
+	const std::string_view Value = Storage ? Storage->Store(Text) : Text;
+	OutCode = static_cast<uint32_t>(mValues.size());
+	mValues.push_back(Value);
+	mLookup.emplace(Value, OutCode);
+	if ((mCodeBits == 8 && Values > 0x100) || (mCodeBits == 16 && Values > 0x10000))
+	{
+		Widen();
+	}
+	return true;
+}
+
+void TextColumn::SetCode(size_t Row, uint32_t Code)
+{
+	switch (mCodeBits)
+	{
+	case 8:
+		mCodes8[Row] = static_cast<uint8_t>(Code);
+		break;
+	case 16:
+		mCodes16[Row] = static_cast<uint16_t>(Code);
+		break;
+	default:
+		mCodes32[Row] = Code;
+		break;
+	}
+}
+
+void TextColumn::Widen()
+{
+	if (mCodeBits == 8)
+	{
+		mCodes16.assign(mCodes8.begin(), mCodes8.end());
+		std::vector<uint8_t>().swap(mCodes8);
+		mCodeBits = 16;
+	}
+	else
+	{
+		mCodes32.assign(mCodes16.begin(), mCodes16.end());
+		std::vector<uint16_t>().swap(mCodes16);
+		mCodeBits = 32;
+	}
+}
+
+void TextColumn::Decode()
+{
+	mPlain.resize(mNumRows);
+	for (size_t Row = 0; Row < mNumRows; ++Row)
+	{
+		mPlain[Row] = mValues[GetCode(Row)];
+	}
+
+	std::vector<uint8_t>().swap(mCodes8);
+	std::vector<uint16_t>().swap(mCodes16);
+	std::vector<uint32_t>().swap(mCodes32);
+	std::vector<std::string_view>().swap(mValues);
+	std::unordered_map<std::string_view, uint32_t>().swap(mLookup);
+	mCodeBits = 0;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "Arena.h"
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+// A column of text cells, dictionary-encoded for as long as that pays. Each distinct value is
+// kept once and rows hold its code, 8, 16 or 32 bits wide depending on how many distinct values
+// there are so far. Once the distinct values outgrow an eighth of the rows, codes plus the
+// dictionary cost more than one view per row, so the column switches to plain views for good.
+// Code 0 is the empty string, so rows never set read back empty. The text itself lives in an
+// arena owned by the table the column belongs to.
+class TextColumn final
+{
+public:
+
+	void Resize(size_t NumRows);
+	size_t GetNumRows() const { return mNumRows; }
+
+	// Text the column hasn't seen is copied into Storage; pass nullptr when Text is already in an
+	// arena that outlives the column. Values are null-terminated either way.
+	void Set(size_t Row, std::string_view Text, Arena* Storage);
+	void Append(std::string_view Text, Arena* Storage);
+	std::string_view Get(size_t Row) const;
+
+	// copies NumRows rows of Source to FirstRow on, translating Source's codes into this column's;
+	// Source's text must outlive this column
+	void CopyRows(const TextColumn& Source, size_t FirstRow, size_t NumRows);
+
+	// Equal codes mean equal text, so grouping and filtering can compare codes and decode only
+	// what they show. Codes are only meaningful while the column is encoded.
+	bool IsEncoded() const { return mCodeBits != 0; }
+	int GetCodeBits() const { return mCodeBits; }
+	size_t GetCardinality() const { return mValues.size(); }
+	uint32_t GetCode(size_t Row) const;
+	std::string_view GetValue(uint32_t Code) const { return mValues[Code]; }
+
+	size_t GetMemoryUsage() const;
+
+private:
+
+	// returns false, having switched the column to plain views, when Text would be one value too many
+	bool Intern(std::string_view Text, Arena* Storage, uint32_t& OutCode);
+	void SetCode(size_t Row, uint32_t Code);
+	void Widen();
+	void Decode();
+
+	int mCodeBits = 8;
+	std::vector<uint8_t> mCodes8;
+	std::vector<uint16_t> mCodes16;
+	std::vector<uint32_t> mCodes32;
+	std::vector<std::string_view> mValues{ std::string_view("", 0) };
+	std::unordered_map<std::string_view, uint32_t> mLookup;
+
+	std::vector<std::string_view> mPlain;
+	size_t mNumRows = 0;
+	// highest row set so far, which the cardinality is judged against
+	size_t mRowsSeen = 0;
+};
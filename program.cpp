@@ -1,48 +1,231 @@
 #include "program.h"
 #include "imgui/imgui.h"
-#include "Serialisation/BinaryReader.h"
-#include "Serialisation/DataTable.h"
+#include "Database/CsvImporter.h"
+#include "Database/CsvVirtualTable.h"
+#include "Database/QueryExecutor.h"
+#include "Database/ResultCursor.h"
+#include "Database/TableBrowser.h"
 #include <tchar.h>
 #include <stdio.h>
+#include <limits.h>
+#include <string.h>
+#include <algorithm>
 #include <iostream>
-#include <fstream>
-#include <sstream>
 
 
-void DisplayTable(char** result, int rows, int cols)
+void DisplayCell(const ResultSet& result, size_t row, int col)
+{
+    char buffer[64];
+    const char* text = result.FormatCell(row, col, buffer, sizeof(buffer));
+    if (text == NULL) {
+        ImGui::TextDisabled("<NULL>");
+    }
+    else {
+        ImGui::TextUnformatted(text);
+    }
+}
+
+// IMGUI_TABLE_MAX_COLUMNS in the bundled ImGui
+constexpr int MaxGridColumns = 64;
+
+using ColumnNameGetter = std::function<const char*(int)>;
+
+void DrawColumnChooser(GridColumns& grid, const void* source, int cols, const ColumnNameGetter& get_name)
+{
+    if (grid.Source != source || (int)grid.Chosen.size() != cols) {
+        grid.Source = source;
+        grid.Chosen.assign(cols, 1);
+        grid.FirstChosen = 0;
+    }
+
+    if (ImGui::Button("Columns")) {
+        ImGui::OpenPopup("Column Chooser");
+    }
+    if (ImGui::BeginPopup("Column Chooser")) {
+        ImGui::InputText("Filter", grid.Filter, sizeof(grid.Filter));
+
+        std::vector<int> matching;
+        for (int col = 0; col < cols; col++) {
+            if (grid.Filter[0] == 0 || strstr(get_name(col), grid.Filter) != NULL) {
+                matching.push_back(col);
+            }
+        }
+
+        if (ImGui::Button("All")) {
+            for (int col : matching) grid.Chosen[col] = 1;
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("None")) {
+            for (int col : matching) grid.Chosen[col] = 0;
+        }
+
+        if (ImGui::BeginChild("Column List", ImVec2(300, 400))) {
+            ImGuiListClipper clipper;
+            clipper.Begin((int)matching.size());
+            while (clipper.Step()) {
+                for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
+                    const int col = matching[i];
+                    bool checked = grid.Chosen[col] != 0;
+                    ImGui::PushID(col);
+                    if (ImGui::Checkbox(get_name(col), &checked)) {
+                        grid.Chosen[col] = checked;
+                    }
+                    ImGui::PopID();
+                }
+            }
+        }
+        ImGui::EndChild();
+        ImGui::EndPopup();
+    }
+
+    const int chosen = (int)std::count(grid.Chosen.begin(), grid.Chosen.end(), 1);
+    ImGui::SameLine();
+    ImGui::Text("%d of %d columns", chosen, cols);
+
+    // past the table column limit, page through the chosen columns instead
+    if (chosen > MaxGridColumns) {
+        ImGui::SameLine();
+        ImGui::SliderInt("First Column", &grid.FirstChosen, 0, chosen - MaxGridColumns);
+    }
+    grid.FirstChosen = std::max(0, std::min(grid.FirstChosen, chosen - MaxGridColumns));
+
+    grid.Shown.clear();
+    int skipped = 0;
+    for (int col = 0; col < cols && (int)grid.Shown.size() < MaxGridColumns; col++) {
+        if (grid.Chosen[col] && skipped++ >= grid.FirstChosen) {
+            grid.Shown.push_back(col);
+        }
+    }
+}
+
+// Draws any source that hands out rows a page at a time (ResultCursor, TableBrowser); rows
+// whose page isn't resident yet show a placeholder until the executor fetches it.
+template <typename PagedRows>
+void DisplayPagedRows(PagedRows& Cursor, GridColumns& grid)
 {
     ImGuiTableFlags flags = 0
         | ImGuiTableFlags_Borders
         | ImGuiTableFlags_RowBg
         | ImGuiTableFlags_Resizable
         | ImGuiTableFlags_SizingFixedFit
+        | ImGuiTableFlags_ScrollX
         | ImGuiTableFlags_ScrollY
         ;
 
+    DrawColumnChooser(grid, &Cursor, Cursor.GetColumns(), [&Cursor](int col) { return Cursor.GetColumnName(col); });
+
+    const int cols = (int)grid.Shown.size();
+    ImGui::PushID(grid.FirstChosen);
     if (cols > 0 && ImGui::BeginTable("Result", cols, flags)) {
 
         for (int col = 0; col < cols; col++) {
-            ImGui::TableSetupColumn(result[col]);
+            ImGui::TableSetupColumn(Cursor.GetColumnName(grid.Shown[col]));
         }
         ImGui::TableSetupScrollFreeze(0, 1);
         ImGui::TableHeadersRow();
 
-        for (int row = 0; row < rows; row++) {
-            ImGui::TableNextRow();
-            for (int col = 0; col < cols; col++) {
-                ImGui::TableSetColumnIndex(col);
-                const char* text = result[(row + 1) * cols + col];
-                if (text == NULL) {
-                    ImGui::TextDisabled("<NULL>");
+        // only the visible rows touch the cursor, which fetches their pages on demand
+        const int rows = static_cast<int>(std::min<int64_t>(Cursor.GetKnownRows(), INT_MAX));
+        ImGuiListClipper clipper;
+        clipper.Begin(rows);
+        while (clipper.Step()) {
+            ResultPagePtr page;
+            for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++) {
+                ImGui::TableNextRow();
+                if (!page || !page->Contains(row)) {
+                    page = Cursor.GetPageForRow(row);
                 }
-                else {
-                    ImGui::TextUnformatted(text);
+                const bool resident = page && page->Contains(row);
+                for (int col = 0; col < cols; col++) {
+                    if (!ImGui::TableSetColumnIndex(col)) {
+                        continue;
+                    }
+                    if (resident) {
+                        DisplayCell(page->Rows, static_cast<size_t>(row - page->FirstRow), grid.Shown[col]);
+                    }
+                    else {
+                        ImGui::TextDisabled("...");
+                    }
                 }
             }
         }
 
         ImGui::EndTable();
     }
+    ImGui::PopID();
+}
+
+void DisplayStatementResults(const std::string& script, const std::vector<StatementResult>& results)
+{
+    ImGuiTableFlags flags = 0
+        | ImGuiTableFlags_Borders
+        | ImGuiTableFlags_RowBg
+        | ImGuiTableFlags_Resizable
+        | ImGuiTableFlags_SizingFixedFit
+        | ImGuiTableFlags_ScrollY
+        ;
+
+    if (!ImGui::BeginTable("Statements", 5, flags)) {
+        return;
+    }
+
+    ImGui::TableSetupColumn("#");
+    ImGui::TableSetupColumn("Rows");
+    ImGui::TableSetupColumn("Changes");
+    ImGui::TableSetupColumn("Time (ms)");
+    ImGui::TableSetupColumn("Statement");
+    ImGui::TableSetupScrollFreeze(0, 1);
+    ImGui::TableHeadersRow();
+
+    // long migration scripts can run thousands of statements, so only the visible ones are drawn
+    ImGuiListClipper clipper;
+    clipper.Begin((int)results.size());
+    while (clipper.Step()) {
+        for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
+            const auto& result = results[i];
+            ImGui::TableNextRow();
+
+            ImGui::TableSetColumnIndex(0);
+            ImGui::Text("%d", i + 1);
+
+            ImGui::TableSetColumnIndex(1);
+            if (result.Rows) {
+                ImGui::Text(result.Rows->IsRowCountKnown() ? "%lld" : "%lld+", (long long)result.Rows->GetKnownRows());
+            }
+            else {
+                ImGui::TextDisabled("-");
+            }
+
+            ImGui::TableSetColumnIndex(2);
+            ImGui::Text("%lld", (long long)result.Changes);
+
+            ImGui::TableSetColumnIndex(3);
+            ImGui::Text("%.2f", result.Seconds * 1000.0);
+
+            // the first line of the statement, trimmed; the full text and any error go in a tooltip
+            ImGui::TableSetColumnIndex(4);
+            const std::string sql = script.substr(result.SqlOffset, result.SqlLength);
+            const size_t first = sql.find_first_not_of(" \t\r\n");
+            const size_t line_end = first == std::string::npos ? first : sql.find('\n', first);
+            const std::string line = first == std::string::npos ? std::string() : sql.substr(first, line_end - first);
+            if (result.ErrorMessage.empty()) {
+                ImGui::TextUnformatted(line.c_str());
+            }
+            else {
+                ImGui::TextColored(ImVec4(1.0f, 0.3f, 0.3f, 1.0f), "%s", line.c_str());
+            }
+            if (ImGui::IsItemHovered()) {
+                if (result.ErrorMessage.empty()) {
+                    ImGui::SetTooltip("%s", sql.c_str());
+                }
+                else {
+                    ImGui::SetTooltip("%s\n\n%s", sql.c_str(), result.ErrorMessage.c_str());
+                }
+            }
+        }
+    }
+
+    ImGui::EndTable();
 }
 
 Program::Program(OpenFileMethod InOpenFile, OpenFileMethod InNewFile)
@@ -51,6 +234,10 @@ Program::Program(OpenFileMethod InOpenFile, OpenFileMethod InNewFile)
 {
 }
 
+Program::~Program()
+{
+}
+
 void Program::Init()
 {
     auto lang = TextEditor::LanguageDefinition::SQL();
@@ -106,7 +293,14 @@ bool Program::MainLoopUpdate()
 
 void Program::Shutdown()
 {
-    
+    // drop every handle before the database so its executor thread joins while ImGui is still alive
+    mSQLQueryTicket.reset();
+    mSQLFinishedTicket.reset();
+    mSQLResults.clear();
+    mCurrentTable.reset();
+    mImporter.reset();
+    mAllTablesHandle.reset();
+    mActiveDatabase.reset();
 }
 
 void Program::DrawSQLQueryView()
@@ -114,7 +308,6 @@ void Program::DrawSQLQueryView()
     ImGuiIO& io = ImGui::GetIO();
     ImGuiStyle& style = ImGui::GetStyle();
 
-    char* err_msg = NULL;
     bool do_query = false;
 
     if (ImGui::GetFrameCount() == 1) do_query = true;
@@ -128,11 +321,22 @@ void Program::DrawSQLQueryView()
 
     ImGui::SameLine();
 
+    const bool QueryRunning = mSQLQueryTicket && !mSQLQueryTicket->IsFinished();
+
+    bool cancel_query = false;
     if (ImGui::BeginChild("Query Buttons", ImVec2(100, 50))) {
-        if (ImGui::Button("Run Query")) {
-            do_query = true;
+        if (QueryRunning) {
+            if (ImGui::Button("Cancel")) {
+                cancel_query = true;
+            }
+            ImGui::Text("Esc");
+        }
+        else {
+            if (ImGui::Button("Run Query")) {
+                do_query = true;
+            }
+            ImGui::Text("%s+Enter", io.ConfigMacOSXBehaviors ? "Cmd" : "Ctrl");
         }
-        ImGui::Text("%s+Enter", io.ConfigMacOSXBehaviors ? "Cmd" : "Ctrl");
     }
     ImGui::EndChild();
 
@@ -142,23 +346,37 @@ void Program::DrawSQLQueryView()
     if (ctrl && !shift && !alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_Enter), false)) {
         do_query = true;
     }
+    if (QueryRunning && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_Escape), false)) {
+        cancel_query = true;
+    }
+
+    if (cancel_query) {
+        mActiveDatabase->CancelQuery(mSQLQueryTicket);
+    }
 
     auto cpos = editor.GetCursorPosition();
     auto selection = editor.GetSelectedText();
+    const StatementCache& ui_statements = mActiveDatabase->GetStatementCache();
+    const StatementCache& worker_statements = mActiveDatabase->GetExecutorStatementCache();
+    const unsigned long long cache_hits = ui_statements.GetHits() + worker_statements.GetHits();
+    const unsigned long long cache_misses = ui_statements.GetMisses() + worker_statements.GetMisses();
+    const double arena_mb = Arena::GetTotalBytesReserved() / (1024.0 * 1024.0);
     char info_text[1024];
     if (selection.empty()) {
         snprintf(info_text, sizeof(info_text),
-            "line %d/%d, column %d | %s",
+            "line %d/%d, column %d | %s | stmt cache %llu hits, %llu misses | arenas %.1f MB in %zu chunks",
             cpos.mLine + 1,
             editor.GetTotalLines(),
             cpos.mColumn + 1,
-            editor.IsOverwrite() ? "Ovr" : "Ins");
+            editor.IsOverwrite() ? "Ovr" : "Ins",
+            cache_hits, cache_misses, arena_mb, Arena::GetTotalChunks());
     }
     else {
         snprintf(info_text, sizeof(info_text),
-            "selected %d characters | %s",
+            "selected %d characters | %s | stmt cache %llu hits, %llu misses | arenas %.1f MB in %zu chunks",
             (int)selection.length(),
-            editor.IsOverwrite() ? "Ovr" : "Ins");
+            editor.IsOverwrite() ? "Ovr" : "Ins",
+            cache_hits, cache_misses, arena_mb, Arena::GetTotalChunks());
     }
 
     ImVec2 pos = ImGui::GetCursorPos();
@@ -167,29 +385,90 @@ void Program::DrawSQLQueryView()
     // ImGui::SetItemAllowOverlap();
     ImGui::SetCursorPos(pos);
 
-    if (do_query) {
-        if (err_msg) {
-            sqlite3_free(err_msg);
-            err_msg = NULL;
-        }
-        char query[1024];
-        snprintf(query, sizeof(query), "%s", editor.GetText().c_str());
+    if (do_query && !QueryRunning) {
+        mSQLQueryTicket = mActiveDatabase->SubmitQuery(editor.GetText(), mSQLSingleTransaction);
+    }
 
-        mSQLTableHandle = TableHandle::BuildTable(query, mActiveDatabase);
+    ImGui::Checkbox("Single transaction", &mSQLSingleTransaction);
+    if (ImGui::IsItemHovered()) {
+        ImGui::SetTooltip("Run the whole script in one transaction and roll it back if any statement fails");
+    }
 
-        if (!mSQLTableHandle->IsValid()) {
-            fprintf(stderr, "SQL error: %s\n", mSQLTableHandle->GetErrorMessage());
+    if (mSQLQueryTicket) {
+        if (mSQLQueryTicket->GetState() == QueryState::Cancelled) {
+            mSQLFinishedTicket.reset();
+            mSQLResults.clear();
+            mSQLErrorMessage.clear();
+            ImGui::Text("Query cancelled after %.1fs", mSQLQueryTicket->GetElapsedSeconds());
+        }
+        else if (mSQLQueryTicket->IsFinished()) {
+            mSQLResults = mSQLQueryTicket->GetStatementResults();
+            mSQLErrorMessage = mSQLQueryTicket->GetErrorMessage();
+            mSQLFinishedTicket = std::move(mSQLQueryTicket);
+            mSQLGridColumns.clear();
+            mSQLGridColumns.resize(mSQLResults.size());
+
+            // the browsed table may have been written to; reopen it so its pages aren't stale
+            if (std::any_of(mSQLResults.begin(), mSQLResults.end(), [](const StatementResult& result) { return result.Changes > 0; })) {
+                mCurrentTable.reset();
+            }
+
+            if (!mSQLErrorMessage.empty()) {
+                fprintf(stderr, "SQL error: %s\n", mSQLErrorMessage.c_str());
+            }
+        }
+        else if (mSQLQueryTicket->IsCancelRequested()) {
+            ImGui::Text("Cancelling... %.1fs", mSQLQueryTicket->GetElapsedSeconds());
+        }
+        else {
+            ImGui::Text("Running... %.1fs | %zu statements | %.2fM VM steps/s",
+                mSQLQueryTicket->GetElapsedSeconds(),
+                mSQLQueryTicket->GetStatementsRun(),
+                mSQLQueryTicket->GetVMStepsPerSecond() / 1000000.0);
         }
     }
 
-    if (err_msg) {
-        ImGui::Text("%s", err_msg);
+    if (mSQLFinishedTicket) {
+        ImGui::Text("%zu statements in %.3fs%s", mSQLResults.size(), mSQLFinishedTicket->GetElapsedSeconds(),
+            mSQLFinishedTicket->IsSingleTransaction() ? (mSQLErrorMessage.empty() ? ", committed" : ", rolled back") : "");
     }
 
-    if (mSQLTableHandle && mSQLTableHandle->IsValid()) {
-        ImGui::Text("Result %d rows, %d cols", mSQLTableHandle->GetRows(), mSQLTableHandle->GetColumns());
+    if (!mSQLErrorMessage.empty()) {
+        ImGui::TextUnformatted(mSQLErrorMessage.c_str());
+    }
 
-        DisplayTable(mSQLTableHandle->GetTable(), mSQLTableHandle->GetRows(), mSQLTableHandle->GetColumns());
+    if (mSQLFinishedTicket && ImGui::BeginTabBar("##results")) {
+        for (size_t i = 0; i < mSQLResults.size(); i++) {
+            const auto& result = mSQLResults[i];
+            if (!result.Rows) {
+                continue;
+            }
+
+            char label[64];
+            snprintf(label, sizeof(label), "Result %zu###result%zu", i + 1, i);
+            if (ImGui::BeginTabItem(label)) {
+                ResultCursor& cursor = *result.Rows;
+                const std::string cursor_error = cursor.GetErrorMessage();
+                if (cursor.IsRowCountKnown()) {
+                    ImGui::Text("%lld rows, %d cols", (long long)cursor.GetKnownRows(), cursor.GetColumns());
+                }
+                else {
+                    ImGui::Text("%lld+ rows (counting), %d cols", (long long)cursor.GetKnownRows(), cursor.GetColumns());
+                }
+                if (!cursor_error.empty()) {
+                    ImGui::TextUnformatted(cursor_error.c_str());
+                }
+
+                DisplayPagedRows(cursor, mSQLGridColumns[i]);
+                ImGui::EndTabItem();
+            }
+        }
+
+        if (ImGui::BeginTabItem("Messages")) {
+            DisplayStatementResults(mSQLFinishedTicket->GetQuery(), mSQLResults);
+            ImGui::EndTabItem();
+        }
+        ImGui::EndTabBar();
     }
 }
 
@@ -215,96 +494,63 @@ void Program::DrawTablesView()
 
         ImGui::InputText("Table Name", mTableName, _MAX_PATH);
         if (ImGui::Button("Import Table (.csv)")) {
-            if (OpenFile && mTableName[0])
+            if (OpenFile && mTableName[0] && !(mImporter && !mImporter->IsFinished()))
             {
-                TypedDataTablePtr IncomingDataTable;
                 std::string FilePath = OpenFile(".csv\0");
                 if (FilePath.size() > 0)
                 {
-                    std::ifstream InFileStream(FilePath);
-                    std::stringstream ss;
-                    if (InFileStream)
-                    {
-                        ss << InFileStream.rdbuf();
-                        const auto String = ss.str();
-                        BinaryReader Reader(reinterpret_cast<const uint8_t*>(String.data()), String.size());
-
-                        IncomingDataTable = TypedDataTable::CreateFromCSV(Reader, 1, 0, nullptr);
-                    }
+                    mImporter = mActiveDatabase->ImportCSV(FilePath, mTableName, mImportBulkLoad);
+                    mImportErrorMessage = mImporter ? "" : "Failed to open " + FilePath;
                 }
-                if (IncomingDataTable)
-                {
-                    // create table in database
-                    std::stringstream Qss;
-                    Qss << "CREATE TABLE " << mTableName << " (";
-                    auto ColumnHeaders = IncomingDataTable->GetColumnHeaders();
-                    for (auto& Header : ColumnHeaders)
-                    {
-                        std::replace(Header.begin(), Header.end(), ' ', '_');
-                    }
-                    for (auto i = 0; i < ColumnHeaders.size(); i++)
-                    {
-                        Qss << ColumnHeaders[i] << " " << TypedDataTable::GetColumnDataTypeName(IncomingDataTable->GetColumnDataType(i));
-                        if (i != ColumnHeaders.size() - 1) Qss << ",";
-                    }
-                    Qss << " );";
-                    auto NewTable = mActiveDatabase->BuildTable(Qss.str().c_str());
-                    if (NewTable->IsValid())
-                    {
-                        std::stringstream InsertQuery;
-                        InsertQuery << "INSERT INTO " << mTableName << " VALUES (";
-                        for (auto i = 0; i < ColumnHeaders.size(); i++)
-                        {
-                            InsertQuery << "@" << ColumnHeaders[i];
-                            if (i != ColumnHeaders.size() - 1) InsertQuery << ",";
-                        }
-                        InsertQuery << ");";
-                        auto db = &mActiveDatabase->GetImpl();
-                        std::string Query = InsertQuery.str();
-                        sqlite3_stmt* Statement;
-                        char* sErrMsg = 0;
-                        const char* tail = 0;
-                        sqlite3_exec(db, "BEGIN TRANSACTION", NULL, NULL, &sErrMsg);
-
-                        if (sqlite3_prepare_v2(db, Query.c_str(), Query.length(), &Statement, &tail))
-                            fprintf(stderr, "Failed to prepare for entry %s: %s", FilePath.c_str(), sqlite3_errmsg(db));
-
-                        for (auto RowId = 0; RowId < IncomingDataTable->GetNumRows(); ++RowId)
-                        {
-                            for (auto ColumnId = 0; ColumnId < ColumnHeaders.size(); ++ColumnId)
-                            {
-                                if (const auto* String = IncomingDataTable->GetCellAsString(RowId, ColumnId))
-                                {
-                                    sqlite3_bind_text(Statement, ColumnId + 1, String->c_str(), String->length(), SQLITE_TRANSIENT);
-                                }
-                                else { return; }
-                            }
-
-                            sqlite3_step(Statement);
-
-                            sqlite3_clear_bindings(Statement);
-                            sqlite3_reset(Statement);
-                        }
-
-                        sqlite3_exec(db, "END TRANSACTION", NULL, NULL, &sErrMsg);
-                    }
-                    else
-                    {
-                        fprintf(stderr, "SQL error: %s\n", NewTable->GetErrorMessage());
-                    }
-                    mAllTablesHandle = TableHandle::BuildTable("select name from sqlite_master where type='table'", mActiveDatabase);
+            }
+        }
+        ImGui::SameLine();
+        ImGui::Checkbox("Bulk load", &mImportBulkLoad);
+        if (ImGui::IsItemHovered()) {
+            ImGui::SetTooltip("Skip syncs and keep the journal in memory while importing, and rebuild the table's indexes once at the end.\nFaster, but a crash mid-import can corrupt the database.");
+        }
 
+        if (mImporter)
+        {
+            if (!mImporter->IsFinished())
+            {
+                ImGui::ProgressBar(mImporter->GetProgress(), ImVec2(-1.0f, 0.0f));
+                ImGui::Text("Importing %s: %lld rows, %.0f rows/s, %.1f MB/s, queue %zu/%zu", mImporter->GetTableName().c_str(),
+                    (long long)mImporter->GetRowsImported(), mImporter->GetRowsPerSecond(), mImporter->GetMegabytesPerSecond(),
+                    mImporter->GetQueuedBatches(), mImporter->GetQueueCapacity());
+                ImGui::SameLine();
+                if (ImGui::Button("Cancel Import"))
+                {
+                    mImporter->Cancel();
                 }
             }
+            else
+            {
+                mImportErrorMessage = mImporter->GetErrorMessage();
+                mImporter.reset();
+                mAllTablesHandle = TableHandle::BuildTable("select name from sqlite_master where type='table'", mActiveDatabase);
+                mCurrentTable.reset();
+            }
+        }
+        if (!mImportErrorMessage.empty())
+        {
+            ImGui::TextColored(ImVec4(1.0f, 0.3f, 0.3f, 1.0f), "Import failed: %s", mImportErrorMessage.c_str());
         }
     }
     if (NewDatabaseFilePath.size() > 0)
     {
+        // the importer may still have to restore the old connection's settings through its executor
+        mImporter.reset();
         mActiveDatabase = DatabaseHandle::CreateDatabase(NewDatabaseFilePath);
         mAllTablesHandle = TableHandle::BuildTable("select name from sqlite_master where type='table'", mActiveDatabase);
 
-        mSQLTableHandle.reset();
-        mCurrentTableFullContents.reset();
+        // a ticket still queued on the old executor would otherwise keep the Run button hidden
+        mSQLQueryTicket.reset();
+        mSQLFinishedTicket.reset();
+        mSQLResults.clear();
+        mSQLErrorMessage.clear();
+        mCurrentTable.reset();
+        mImportErrorMessage.clear();
     }
     ImGui::NewLine();
 
@@ -312,11 +558,16 @@ void Program::DrawTablesView()
     {
         DrawAllTablesCombo();
 
-        if (mCurrentTableFullContents)
+        if (mCurrentTable && mCurrentTable->IsReady())
         {
-            ImGui::Text("%d rows, %d cols", mCurrentTableFullContents->GetRows(), mCurrentTableFullContents->GetColumns());
+            ImGui::Text(mCurrentTable->IsRowCountKnown() ? "%lld rows, %d cols" : "%lld+ rows (counting), %d cols",
+                (long long)mCurrentTable->GetKnownRows(), mCurrentTable->GetColumns());
+            if (const size_t index_bytes = mCurrentTable->GetRowidIndexMemoryUsage()) {
+                ImGui::SameLine();
+                ImGui::TextDisabled("| rowid index %.1f MB", index_bytes / (1024.0 * 1024.0));
+            }
 
-            DisplayTable(mCurrentTableFullContents->GetTable(), mCurrentTableFullContents->GetRows(), mCurrentTableFullContents->GetColumns());
+            DisplayPagedRows(*mCurrentTable, mTableGridColumns);
         }
     }
 }
@@ -327,11 +578,10 @@ void Program::DrawRecordsView()
     {
         DrawAllTablesCombo();
 
-        if (mCurrentTableFullContents && mCurrentTableFullContents->IsValid())
+        if (mCurrentTable && mCurrentTable->IsReady() && mCurrentTable->GetKnownRows() > 0)
         {
-            const int rows = mCurrentTableFullContents->GetRows();
-            const int cols = mCurrentTableFullContents->GetColumns();
-            char** result = mCurrentTableFullContents->GetTable();
+            const int rows = static_cast<int>(std::min<int64_t>(mCurrentTable->GetKnownRows(), INT_MAX));
+            const int cols = mCurrentTable->GetColumns();
             // Pick one record
             static int record_index = 1;
             if (record_index > rows) {
@@ -353,6 +603,11 @@ void Program::DrawRecordsView()
 
             ImGui::SliderInt("Record Index", &record_index, 1, rows);
 
+            // just this record and a few neighbours are fetched, in the background
+            const ResultPagePtr page = mCurrentTable->GetRecord(record_index - 1);
+            const bool resident = page && page->Contains(record_index - 1);
+            const bool missing = page && page->Rows.GetRows() == 0;
+
             ImGuiTableFlags flags = 0
                 | ImGuiTableFlags_Borders
                 | ImGuiTableFlags_RowBg
@@ -361,19 +616,28 @@ void Program::DrawRecordsView()
                 ;
             if (ImGui::BeginTable("Record", 2, flags))
             {
-                for (int col = 0; col < cols; col++) {
-                    const char* column_name = result[col];
-                    const char* value = result[record_index * cols + col];
-
-                    ImGui::TableNextRow();
-
-                    ImGui::TableSetColumnIndex(0);
-                    ImGui::AlignTextToFramePadding();
-                    ImGui::TextUnformatted(column_name);
-
-                    ImGui::TableSetColumnIndex(1);
-                    ImGui::AlignTextToFramePadding();
-                    ImGui::TextUnformatted(value);
+                // one table row per column, so wide tables only submit the columns in view
+                ImGuiListClipper clipper;
+                clipper.Begin(record_index <= rows ? cols : 0);
+                while (clipper.Step()) {
+                    for (int col = clipper.DisplayStart; col < clipper.DisplayEnd; col++) {
+                        const char* column_name = mCurrentTable->GetColumnName(col);
+
+                        ImGui::TableNextRow();
+
+                        ImGui::TableSetColumnIndex(0);
+                        ImGui::AlignTextToFramePadding();
+                        ImGui::TextUnformatted(column_name);
+
+                        ImGui::TableSetColumnIndex(1);
+                        ImGui::AlignTextToFramePadding();
+                        if (resident) {
+                            DisplayCell(page->Rows, static_cast<size_t>(record_index - 1 - page->FirstRow), col);
+                        }
+                        else {
+                            ImGui::TextDisabled(missing ? "(row not found)" : "...");
+                        }
+                    }
                 }
                 ImGui::EndTable();
             }
@@ -385,25 +649,29 @@ void Program::DrawAllTablesCombo()
 {
     if (mAllTablesHandle->GetRows() < 1)
         return;
-    auto RawTable = mAllTablesHandle->GetTable();
+    const ResultSet& TableNames = mAllTablesHandle->GetResult();
+    const auto GetTableName = [](void* Data, int Index, const char** OutText) {
+        *OutText = static_cast<const ResultSet*>(Data)->GetText(Index, 0);
+        return true;
+    };
     // pick a table
     int SelectedTableIndex = mSelectedTableIndex;
-    ImGui::Combo("Table", &SelectedTableIndex, &RawTable[1], mAllTablesHandle->GetRows());
+    ImGui::Combo("Table", &SelectedTableIndex, GetTableName, const_cast<ResultSet*>(&TableNames), mAllTablesHandle->GetRows());
     
     if (mAllTablesHandle->GetColumns() > mSelectedTableIndex);
 
-    if (SelectedTableIndex != mSelectedTableIndex || (!mCurrentTableFullContents || !mCurrentTableFullContents->IsValid()))
+    if (SelectedTableIndex != mSelectedTableIndex || !mCurrentTable)
     {
-        mSelectedTableIndex = SelectedTableIndex;
-        char q[256];
-        snprintf(q, sizeof(q), "select * from %s", RawTable[mSelectedTableIndex + 1]);
-        mCurrentTableFullContents = TableHandle::BuildTable(q, mActiveDatabase);
-
-        if (!mCurrentTableFullContents->IsValid()) {
-            fprintf(stderr, "SQL error: %s\n", mCurrentTableFullContents->GetErrorMessage());
-            mAllTablesHandle = TableHandle::BuildTable("select name from sqlite_master where type='table'", mActiveDatabase);
+        mSelectedTableIndex = SelectedTableIndex < mAllTablesHandle->GetRows() ? SelectedTableIndex : 0;
+        mCurrentTable = mActiveDatabase->BrowseTable(TableNames.GetText(mSelectedTableIndex, 0));
+    }
 
-        }
+    const std::string table_error = mCurrentTable->GetErrorMessage();
+    if (!table_error.empty()) {
+        ImGui::TextUnformatted(table_error.c_str());
+    }
+    else if (!mCurrentTable->IsReady()) {
+        ImGui::TextDisabled("Loading...");
     }
 }
 
@@ -412,24 +680,66 @@ std::shared_ptr<TableHandle> TableHandle::BuildTable(const char* Query, const st
     std::shared_ptr<TableHandle> Table;
     if (Database)
     {
-        Table = std::make_shared <TableHandle>(Database);
-
-        const int ReturnCode = sqlite3_get_table(
-            &Database->GetImpl(),
-            Query,
-            &Table->mResult,
-            &Table->mRows,
-            &Table->mColumns,
-            &Table->mErrorMessage
-        );
-
-        if (ReturnCode != SQLITE_OK) {
-            if (Table->mResult)
+        Table = BuildTable(Query, Database->GetStatementCache());
+    }
+    return Table;
+}
+
+std::shared_ptr<TableHandle> TableHandle::BuildTable(const char* Query, StatementCache& Statements)
+{
+    auto Table = std::make_shared<TableHandle>();
+    Table->mValid = true;
+    sqlite3& Connection = Statements.GetConnection();
+
+    // every statement runs in order; the last one that returns columns provides the rows
+    const char* Sql = Query;
+    while (Sql && Sql[0])
+    {
+        sqlite3_stmt* Statement = nullptr;
+        const char* Tail = nullptr;
+        const bool Prepared = Statements.AcquireNext(Sql, Statement, Tail);
+        Sql = Tail;
+        if (!Prepared)
+        {
+            Table->mErrorMessage = sqlite3_errmsg(&Connection);
+            Table->mValid = false;
+            break;
+        }
+        if (!Statement)
+        {
+            continue;
+        }
+
+        const int NumColumns = sqlite3_column_count(Statement);
+        if (NumColumns > 0)
+        {
+            Table->mResult = ResultSet(NumColumns);
+            Table->mColumnNames.clear();
+            for (int Column = 0; Column < NumColumns; ++Column)
             {
-                sqlite3_free_table(Table->mResult);
-                Table->mResult = nullptr;
+                const char* Name = sqlite3_column_name(Statement, Column);
+                Table->mColumnNames.emplace_back(Name ? Name : "");
             }
         }
+
+        int ReturnCode = sqlite3_step(Statement);
+        while (ReturnCode == SQLITE_ROW)
+        {
+            Table->mResult.AppendRow(*Statement);
+            ReturnCode = sqlite3_step(Statement);
+        }
+
+        if (ReturnCode != SQLITE_DONE)
+        {
+            Table->mErrorMessage = sqlite3_errmsg(&Connection);
+            Table->mValid = false;
+        }
+        Statements.Release(Statement);
+
+        if (!Table->mValid)
+        {
+            break;
+        }
     }
     return Table;
 }
@@ -440,11 +750,6 @@ TableHandle::TableHandle(std::shared_ptr<DatabaseHandle> Database)
 
 TableHandle::~TableHandle()
 {
-    if (mResult)
-    {
-        sqlite3_free_table(mResult);
-        mResult = nullptr;
-    }
 }
 
 std::shared_ptr<DatabaseHandle> DatabaseHandle::CreateDatabase(const std::string& FilePath)
@@ -469,11 +774,42 @@ std::shared_ptr<DatabaseHandle> DatabaseHandle::CreateDatabase(const std::string
 
 DatabaseHandle::DatabaseHandle(sqlite3& Database)
     : mDatabase(Database)
+    , mStatements(Database)
 {
+    constexpr int BusyTimeoutMs = 5000;
+    sqlite3_busy_timeout(&mDatabase, BusyTimeoutMs);
+    CsvVirtualTable::Register(mDatabase);
+
+    // the executor gets its own connection so the UI can keep browsing while a query runs;
+    // in-memory and temporary databases have no file to reopen, so those share this one
+    sqlite3* WorkerConnection = nullptr;
+    const char* FilePath = sqlite3_db_filename(&mDatabase, "main");
+    if (FilePath && FilePath[0])
+    {
+        if (sqlite3_open_v2(FilePath, &WorkerConnection, SQLITE_OPEN_READWRITE | SQLITE_OPEN_FULLMUTEX, nullptr) != SQLITE_OK)
+        {
+            fprintf(stderr, "Failed to open worker connection %s: %s", FilePath, sqlite3_errmsg(WorkerConnection));
+            sqlite3_close(WorkerConnection);
+            WorkerConnection = nullptr;
+        }
+    }
+
+    if (WorkerConnection)
+    {
+        sqlite3_busy_timeout(WorkerConnection, BusyTimeoutMs);
+        CsvVirtualTable::Register(*WorkerConnection);
+        mExecutor = std::make_unique<QueryExecutor>(*WorkerConnection, true);
+    }
+    else
+    {
+        mExecutor = std::make_unique<QueryExecutor>(mDatabase, false);
+    }
 }
 
 DatabaseHandle::~DatabaseHandle()
 {
+    mExecutor.reset();
+    mStatements.Clear();
     sqlite3_close(&mDatabase);
 }
 
@@ -489,3 +825,28 @@ const char* DatabaseHandle::RunQuery(const char* Query)
         &mDatabase, Query, nullptr, nullptr, &Result);
     return RC ? Result : nullptr;
 }
+
+std::shared_ptr<QueryTicket> DatabaseHandle::SubmitQuery(const std::string& Query, bool SingleTransaction)
+{
+    return mExecutor->Submit(Query, SingleTransaction);
+}
+
+void DatabaseHandle::CancelQuery(const std::shared_ptr<QueryTicket>& Ticket)
+{
+    mExecutor->Cancel(Ticket);
+}
+
+std::shared_ptr<TableBrowser> DatabaseHandle::BrowseTable(const std::string& TableName)
+{
+    return TableBrowser::Open(*mExecutor, TableName);
+}
+
+std::shared_ptr<CsvImporter> DatabaseHandle::ImportCSV(const std::string& FilePath, const std::string& TableName, bool BulkLoad)
+{
+    return CsvImporter::Start(*mExecutor, FilePath, TableName, BulkLoad);
+}
+
+const StatementCache& DatabaseHandle::GetExecutorStatementCache() const
+{
+    return mExecutor->GetStatementCache();
+}
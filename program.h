@@ -1,20 +1,30 @@
 
 #include "sqlite/sqlite3.h"
 #include "ImGuiColorTextEdit/TextEditor.h"
+#include "Database/ResultSet.h"
+#include "Database/StatementCache.h"
 #include <functional>
 #include <string>
 #include <memory>
+#include <vector>
 
 struct sqlite3;
 
 using OpenFileMethod = std::function <std::string(const char*)>;
+class CsvImporter;
 class DatabaseHandle;
+class QueryExecutor;
+class QueryTicket;
+class ResultCursor;
+class TableBrowser;
+struct StatementResult;
 
 class TableHandle final
 {
 public:
 	
 	static std::shared_ptr<TableHandle> BuildTable(const char* Query, const std::shared_ptr<DatabaseHandle>& Database);
+	static std::shared_ptr<TableHandle> BuildTable(const char* Query, StatementCache& Statements);
 
 	TableHandle(std::shared_ptr<DatabaseHandle> Database);
 	TableHandle() = default;
@@ -25,20 +35,21 @@ public:
 	TableHandle& operator=(const TableHandle& Rhs) = delete;
 	TableHandle& operator=(const TableHandle&& Rhs) = delete;
 
-	bool IsValid() const { return mResult != nullptr; }
-	const char* GetErrorMessage() { return mErrorMessage ? mErrorMessage : "Success"; }
+	bool IsValid() const { return mValid; }
+	const char* GetErrorMessage() { return mErrorMessage.empty() ? "Success" : mErrorMessage.c_str(); }
 
-	char** GetTable() const { return mResult; }
-	int GetRows() const { return mRows; }
-	int GetColumns() const { return mColumns; }
+	const ResultSet& GetResult() const { return mResult; }
+	const char* GetColumnName(int Column) const { return mColumnNames[Column].c_str(); }
+	int GetRows() const { return static_cast<int>(mResult.GetRows()); }
+	int GetColumns() const { return mResult.GetColumns(); }
 
 private:
 
 	std::shared_ptr<DatabaseHandle> mSourceDatabase;
-	char** mResult = nullptr;
-	char* mErrorMessage = nullptr;
-	int mRows= 0;
-	int mColumns= 0;
+	ResultSet mResult;
+	std::vector<std::string> mColumnNames;
+	std::string mErrorMessage;
+	bool mValid = false;
 };
 
 class DatabaseHandle final : public std::enable_shared_from_this<DatabaseHandle>
@@ -58,11 +69,37 @@ public:
 	std::shared_ptr<TableHandle> BuildTable(const char* Query);
 	const char* RunQuery(const char* Query);
 
+	// runs on the background executor; poll the ticket each frame for the result
+	std::shared_ptr<QueryTicket> SubmitQuery(const std::string& Query, bool SingleTransaction);
+	void CancelQuery(const std::shared_ptr<QueryTicket>& Ticket);
+
+	// pages through a table on the executor without loading it; see TableBrowser
+	std::shared_ptr<TableBrowser> BrowseTable(const std::string& TableName);
+
+	// creates or appends to TableName and streams the file into it in batches on the executor;
+	// see CsvImporter for what BulkLoad changes
+	std::shared_ptr<CsvImporter> ImportCSV(const std::string& FilePath, const std::string& TableName, bool BulkLoad);
+
 	sqlite3& GetImpl() const { return mDatabase; }
+	StatementCache& GetStatementCache() { return mStatements; }
+	const StatementCache& GetExecutorStatementCache() const;
 
 private:
 
 	sqlite3& mDatabase;
+	StatementCache mStatements;
+	std::unique_ptr<QueryExecutor> mExecutor;
+};
+
+// Which result columns a grid shows. ImGui tables cap how many columns they can hold, so
+// wide results are shown through a sliding window over the chosen columns.
+struct GridColumns
+{
+	const void* Source = nullptr;
+	std::vector<uint8_t> Chosen;
+	std::vector<int> Shown;
+	int FirstChosen = 0;
+	char Filter[64] = { 0 };
 };
 
 class Program
@@ -70,6 +107,7 @@ class Program
 public: 
 
 	Program(OpenFileMethod InOpenFile, OpenFileMethod InNewFile);
+	~Program();
 
 	void Init();
 	bool MainLoopUpdate();
@@ -88,9 +126,18 @@ private:
 	TextEditor editor;
 
 	std::shared_ptr<DatabaseHandle> mActiveDatabase;
-	std::shared_ptr<TableHandle> mSQLTableHandle;
+	std::shared_ptr<QueryTicket> mSQLQueryTicket;
+	std::shared_ptr<QueryTicket> mSQLFinishedTicket;
+	std::vector<StatementResult> mSQLResults;
+	std::vector<GridColumns> mSQLGridColumns;
+	std::string mSQLErrorMessage;
+	bool mSQLSingleTransaction = false;
+	GridColumns mTableGridColumns;
 	std::shared_ptr<TableHandle> mAllTablesHandle;
-	std::shared_ptr<TableHandle> mCurrentTableFullContents;
+	std::shared_ptr<TableBrowser> mCurrentTable;
+	std::shared_ptr<CsvImporter> mImporter;
+	std::string mImportErrorMessage;
+	bool mImportBulkLoad = false;
 	int mSelectedTableIndex = 0;
 	char mTableName[_MAX_PATH] = { 0 };
 };
\ No newline at end of file